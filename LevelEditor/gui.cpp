@@ -1,6 +1,8 @@
 #include "gui.hpp"
 
 #include <Primrose/engine/setup.hpp>
+#include <Primrose/engine/runtime.hpp>
+#include <Primrose/state.hpp>
 #include <Primrose/scene/scene.hpp>
 #include <Primrose/scene/primitive_node.hpp>
 #include <Primrose/scene/node_visitor.hpp>
@@ -363,6 +365,16 @@ public:
 		ImGui::SeparatorText("CylinderNode");
 		*modified |= addFloat("Radius", node->radius);
 	}
+	void visit(NoiseRockNode* node) override {
+		ImGui::SeparatorText("NoiseRockNode");
+		*modified |= addFloat("Height", node->height);
+		*modified |= addFloat("Frequency", node->frequency);
+	}
+	void visit(NoiseTerrainNode* node) override {
+		ImGui::SeparatorText("NoiseTerrainNode");
+		*modified |= addFloat("Height", node->height);
+		*modified |= addFloat("Frequency", node->frequency);
+	}
 	void visit(UnionNode* node) override {
 		ImGui::SeparatorText("UnionNode");
 	}
@@ -433,6 +445,47 @@ bool updateGui(Primrose::Scene& scene, float dt) {
 	ImGui::Begin("FPS", nullptr,
 		ImGuiWindowFlags_NoMove | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoDecoration);
 	ImGui::Text("FPS: %.2f", 1.f / dt);
+	ImGui::Text("Render scale: %.2f", Primrose::renderScale);
+	float targetFrameTime = Primrose::targetFrameTime;
+	if (ImGui::DragFloat("Target ms", &targetFrameTime, 0.1f, 0.f, 100.f)) {
+		Primrose::setTargetFrameTime(targetFrameTime);
+	}
+	float relaxation = Primrose::uniforms.relaxation;
+	if (ImGui::DragFloat("Relaxation", &relaxation, 0.01f, 1.f, 1.9f)) {
+		Primrose::setRelaxation(relaxation);
+	}
+	static int qualityIndex = static_cast<int>(Primrose::Settings::qualityPreset);
+	const char* qualityNames[] = { "Low", "Medium", "High" };
+	if (ImGui::Combo("Quality", &qualityIndex, qualityNames, 3)) {
+		Primrose::setQualityPreset(static_cast<Primrose::QUALITY>(qualityIndex));
+		modifiedScene |= Primrose::rayAcceleration; // ray tracing pipelines are rebuilt with the scene
+	}
+	bool debugBackground = Primrose::quality.debugBackground;
+	if (ImGui::Checkbox("Debug background", &debugBackground)) {
+		Primrose::QualitySettings settings = Primrose::quality;
+		settings.debugBackground = debugBackground;
+		Primrose::setQuality(settings);
+		modifiedScene |= Primrose::rayAcceleration;
+	}
+	if (Primrose::computeMarch) {
+		ImGui::Text("Steps per pixel: %.1f", Primrose::marchStepsPerPixel);
+		ImGui::Text("Dropped bounces: %u", Primrose::droppedBounces);
+		const char* interleaveNames[] = { "Full", "Half", "Quarter" };
+		int interleaveIndex = Primrose::interleave == 4 ? 2 : Primrose::interleave == 2 ? 1 : 0;
+		if (ImGui::Combo("Pixels marched", &interleaveIndex, interleaveNames, 3)) {
+			Primrose::setInterleave(1u << interleaveIndex);
+		}
+		int bounceIndex = Primrose::bounceScale == 4 ? 2 : Primrose::bounceScale == 2 ? 1 : 0;
+		if (ImGui::Combo("Bounce resolution", &bounceIndex, interleaveNames, 3)) {
+			Primrose::setBounceScale(1u << bounceIndex);
+		}
+	}
+	if (Primrose::rayAcceleration) {
+		const Primrose::StructureMemory& memory = Primrose::structureMemory;
+		ImGui::Text("BLAS: %.1f kb (%.1f kb uncompacted)", memory.bottom / 1024.f, memory.bottomUncompacted / 1024.f);
+		ImGui::Text("TLAS: %.1f kb, scratch: %.1f kb, instances: %.1f kb",
+			memory.top / 1024.f, memory.scratch / 1024.f, memory.instances / 1024.f);
+	}
 	ImGui::End();
 
 	ImGui::ShowDemoWindow();
@@ -559,6 +612,7 @@ bool updateGui(Primrose::Scene& scene, float dt) {
 		}
 
 		modifiedScene |= ImGui::Checkbox("Hide", &clickedNode->hide);
+		modifiedScene |= ImGui::Checkbox("Static", &clickedNode->isStatic); // baked into the brick cache
 
 		static bool sizeIsScalar;
 		DisplayNodeProperties visitor(&modifiedScene, switchedNode, &sizeIsScalar);
@@ -599,6 +653,10 @@ bool updateGui(Primrose::Scene& scene, float dt) {
 			new LineNode(parent, 1, 0.1);
 		} else if (ImGui::Selectable("Cylinder")) {
 			new CylinderNode(parent, 1);
+		} else if (ImGui::Selectable("Rock")) {
+			new NoiseRockNode(parent, 0.3, 2);
+		} else if (ImGui::Selectable("Terrain")) {
+			new NoiseTerrainNode(parent, 1, 0.5);
 		} else if (ImGui::Selectable("Union")) {
 			new UnionNode(parent);
 		} else if (ImGui::Selectable("Intersection")) {
@@ -36,8 +36,7 @@ void update(float dt) {
 	bool updatedScene = updateGui(mainScene, dt);
 	if (updatedScene) {
 		if (rayAcceleration) {
-			destroyAcceleratedScene();
-			generateAcceleratedScene(mainScene);
+			updateAcceleratedScene(mainScene);
 		} else {
 			mainScene.generateUniforms();
 		}
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+
+# usage: ./blue_noise.py > blue_noise.rgba
+# working dir: Primrose/
+# writes the tileable dither texture embedded by the engine, 128x128 rgba8, each channel a separate blue noise frame
+# made with the void and cluster method, it only needs rerunning to change the texture
+
+import random
+import sys
+from math import exp
+
+SIZE = 128
+SIGMA = 1.5
+RADIUS = 5 # energy kernel cut off, exp(-25 / 4.5) < 0.004
+FRAMES = 4
+
+N = SIZE * SIZE
+KERNEL = [(dx, dy, exp(-(dx*dx + dy*dy) / (2 * SIGMA * SIGMA)))
+	for dy in range(-RADIUS, RADIUS + 1) for dx in range(-RADIUS, RADIUS + 1)]
+
+
+class Pattern:
+	def __init__(self):
+		self.bits = [False] * N
+		self.energy = [0.0] * N
+
+	def flip(self, i):
+		self.bits[i] = not self.bits[i]
+		sign = 1.0 if self.bits[i] else -1.0
+		x, y = i % SIZE, i // SIZE
+		for dx, dy, w in KERNEL:
+			self.energy[(y + dy) % SIZE * SIZE + (x + dx) % SIZE] += sign * w
+
+	def tightest_cluster(self):
+		return max((i for i in range(N) if self.bits[i]), key=self.energy.__getitem__)
+
+	def largest_void(self):
+		return min((i for i in range(N) if not self.bits[i]), key=self.energy.__getitem__)
+
+
+def void_and_cluster(rng):
+	# initial pattern, random points relaxed until the tightest cluster is also the largest void
+	pattern = Pattern()
+	for i in rng.sample(range(N), N // 10):
+		pattern.flip(i)
+	while True:
+		cluster = pattern.tightest_cluster()
+		pattern.flip(cluster)
+		void = pattern.largest_void()
+		if void == cluster:
+			pattern.flip(cluster)
+			break
+		pattern.flip(void)
+	initial = list(pattern.bits)
+	ones = sum(initial)
+
+	ranks = [0] * N
+
+	# rank the initial points, removing the tightest cluster first
+	for rank in range(ones - 1, -1, -1):
+		cluster = pattern.tightest_cluster()
+		pattern.flip(cluster)
+		ranks[cluster] = rank
+
+	# rank the rest, filling the largest void first
+	pattern = Pattern()
+	for i in range(N):
+		if initial[i]:
+			pattern.flip(i)
+	for rank in range(ones, N):
+		void = pattern.largest_void()
+		pattern.flip(void)
+		ranks[void] = rank
+
+	return [rank * 256 // N for rank in ranks]
+
+
+def main():
+	rng = random.Random(1)
+	frames = []
+	for frame in range(FRAMES):
+		frames.append(void_and_cluster(rng))
+		print(f"frame {frame + 1}/{FRAMES}", file=sys.stderr)
+
+	data = bytearray(N * FRAMES)
+	for i in range(N):
+		for frame in range(FRAMES):
+			data[i * FRAMES + frame] = frames[frame][i]
+	sys.stdout.buffer.write(data)
+
+
+if __name__ == "__main__":
+	main()
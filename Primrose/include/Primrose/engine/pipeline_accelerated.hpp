@@ -7,6 +7,7 @@ namespace Primrose {
 	void createAcceleratedPipelineLayout();
 
 	void generateAcceleratedScene(Scene& scene);
+	void updateAcceleratedScene(Scene& scene); // refits if only root transforms changed, otherwise regenerates
 	void destroyAcceleratedScene();
 }
 
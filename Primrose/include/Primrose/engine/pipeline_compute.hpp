@@ -0,0 +1,17 @@
+#ifndef PRIMROSE_PIPELINE_COMPUTE_HPP
+#define PRIMROSE_PIPELINE_COMPUTE_HPP
+
+#include <vulkan/vulkan.hpp>
+
+namespace Primrose {
+	const uint32_t MARCH_TILE_SIZE = 8; // width and height of a march.comp workgroup
+	const uint32_t CONE_CELL_SIZE = 8; // pixels per side covered by one cone.comp thread, see constants.glsl
+	const uint32_t BOUNCE_GROUP_SIZE = 64; // rays per bounce.comp workgroup, see bounce.glsl
+	const uint32_t BOUNCE_RAY_SIZE = 48; // bytes per queued bounce ray, see bounce.glsl
+
+	void createComputePipelineLayout();
+	void createComputePipeline();
+	void destroyComputePipeline();
+}
+
+#endif
@@ -8,7 +8,8 @@ namespace Primrose {
 	void createGraphicsPipelineLayout(vk::PipelineLayout* pipelineLayout, vk::DescriptorSetLayout* descLayout);
 	void createGraphicsPipeline(vk::ShaderModule vertModule, vk::ShaderModule fragModule,
 		vk::PipelineVertexInputStateCreateInfo vertInputInfo, vk::PipelineInputAssemblyStateCreateInfo assemblyInfo,
-		vk::PipelineLayout pipelineLayout, vk::Pipeline* pipeline);
+		vk::PipelineLayout pipelineLayout, vk::Pipeline* pipeline,
+		const vk::SpecializationInfo* fragSpecialization = nullptr);
 
 	void createRasterPipelineLayout();
 	void createRasterPipeline();
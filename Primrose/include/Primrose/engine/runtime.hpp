@@ -2,14 +2,23 @@
 #define PRIMROSE_RUNTIME_HPP
 
 #include "setup.hpp"
+#include "../shader_structs.hpp"
 
 namespace Primrose {
 	void setFov(float fov);
 	void setZoom(float zoom);
+	void setTargetFrameTime(float milliseconds);
+	void setInterleave(unsigned int pixels);
+	void setBounceScale(unsigned int scale);
+	void setRelaxation(float omega);
+	void setQualityPreset(QUALITY preset); // keeps the debug background setting
+	void setQuality(QualitySettings settings); // rebuilds the pipelines, ray tracing ones with the next scene
 
 	void run(void(*callback)(float));
 
 	void updateUniforms(FrameInFlight& frame);
+	// records baking staticSubtrees into the brick cache at the start of the frame
+	void bakeBricks(vk::CommandBuffer cmd, FrameInFlight& currentFlight);
 	void drawFrame();
 
 	void recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t imageIndex, FrameInFlight& currentFlight);
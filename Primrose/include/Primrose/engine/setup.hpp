@@ -3,7 +3,10 @@
 
 #include <vulkan/vulkan.hpp>
 #include <GLFW/glfw3.h>
+#include <array>
 #include <vector>
+#include <map>
+#include <string>
 
 namespace Primrose {
 	extern vk::Instance instance; // used as global vulkan state
@@ -11,15 +14,28 @@ namespace Primrose {
 	extern vk::Device device; // logical connection to the physical device
 
 	extern vk::RenderPass renderPass; // render pass with commands used to render a frame
+	extern vk::PipelineCache pipelineCache; // shared by every pipeline, makes recreating them with new quality cheap
 
 	extern bool rayAcceleration;
+	extern bool computeMarch; // whether the scene is marched by a compute shader, only when not ray accelerated
 
 	extern vk::AccelerationStructureKHR topStructure;
 	extern vk::Buffer topStructureBuffer;
 	extern vk::DeviceMemory topStructureMemory;
-	extern vk::AccelerationStructureKHR aabbStructure;
-	extern vk::Buffer aabbStructureBuffer;
-	extern vk::DeviceMemory aabbStructureMemory;
+	struct BottomStructure {
+		vk::AccelerationStructureKHR structure;
+		vk::Buffer buffer;
+		vk::DeviceMemory memory;
+	};
+	extern std::vector<BottomStructure> bottomStructures; // one per unique root subtree, instanced by topStructure
+	extern vk::Buffer attributeBuffer; // ModelAttributes of every aabb in bottomStructures
+	extern vk::DeviceMemory attributeMemory;
+	extern vk::Buffer instanceBuffer; // instances of topStructure, kept to refit it
+	extern vk::DeviceMemory instanceMemory;
+	extern size_t instanceCapacity;
+	extern vk::Buffer structureScratchBuffer; // shared by every acceleration structure build, grown as needed
+	extern vk::DeviceMemory structureScratchMemory;
+	extern vk::DeviceSize structureScratchCapacity;
 
 	extern vk::Buffer rayShaderTable;
 	extern vk::DeviceMemory rayShaderTableMemory;
@@ -28,13 +44,68 @@ namespace Primrose {
 	extern vk::StridedDeviceAddressRegionKHR missGroupAddress;
 	extern vk::StridedDeviceAddressRegionKHR callableGroupAddress;
 
+	extern bool mutableSwapchain; // whether swapchain images can be viewed as unorm, see createSwapchain
+	extern bool traceDirect; // whether rays are traced straight into the swapchain images
+	extern bool traceSrgbEncode; // whether the trace shader has to encode srgb itself
 	extern vk::Image traceImage;
 	extern vk::ImageView traceImageView;
 	extern vk::DeviceMemory traceImageMemory;
+	extern vk::Extent2D renderExtent; // resolution marched into the trace target, at most swapchainExtent
+	extern float timestampPeriod; // nanoseconds per gpu timestamp tick, 0 if timestamps are unsupported
+	extern bool traceBlit; // whether the trace image exists and can be blitted to the swapchain
+	extern vk::Extent2D storageExtent; // allocated size of the trace and history images, at least swapchainExtent
+
+	struct StorageImage { // image read and written by shaders, kept in the general layout
+		vk::Image image;
+		vk::DeviceMemory memory;
+		vk::ImageView view;
+	};
+	extern std::array<StorageImage, 2> historyColorImages; // last frame's shading, indexed by frame parity
+	extern std::array<StorageImage, 2> historyDepthImages; // last frame's primary ray depth
+	extern StorageImage motionImage; // per pixel offset to where the surface was last frame
+	extern StorageImage surfaceImage; // packed normal, material and group of each pixel's primary hit
+	extern StorageImage coneImage; // distance each cell of pixels can skip before marching, one texel per cell
+	extern StorageImage bounceHeadImage; // first queued bounce ray of each pixel, see bounce.glsl
+	extern StorageImage bounceCountImage; // bounce rays queued by each pixel
+	extern StorageImage bounceImage; // each pixel's blended bounces, for upsampling reduced resolution bounces
+	extern vk::Buffer bounceRayBuffer; // wavefront queue of bounce rays
+	extern vk::DeviceMemory bounceRayBufferMemory;
+	extern vk::Buffer bounceCounterBuffer; // BounceCounters, also the bounce pass's indirect dispatch arguments
+	extern vk::DeviceMemory bounceCounterBufferMemory;
+	extern uint32_t bounceCapacity; // rays that fit in bounceRayBuffer
+
+	extern vk::Image brickAtlas; // baked distance samples of static subtrees, see bricks.glsl
+	extern vk::DeviceMemory brickAtlasMemory;
+	extern vk::ImageView brickAtlasView;
+	extern vk::Sampler brickSampler;
+	extern vk::Buffer brickCacheBuffer; // BrickCacheHeader followed by the cells of every volume
+	extern vk::DeviceMemory brickCacheBufferMemory;
+	extern vk::Buffer brickSampleBuffer; // atlas contents written by the bake pass, copied into brickAtlas
+	extern vk::DeviceMemory brickSampleBufferMemory;
+	extern vk::Buffer brickProgramBuffer; // MarchUniforms of each static subtree per frame in flight, for the bake pass
+	extern vk::DeviceMemory brickProgramBufferMemory;
+	extern vk::DeviceSize brickProgramStride; // sizeof(MarchUniforms) rounded up to the uniform offset alignment
+
+	extern vk::Image noiseVolume; // mipmapped tileable noise for procedural primitives, see noise.glsl
+	extern vk::DeviceMemory noiseVolumeMemory;
+	extern vk::ImageView noiseVolumeView;
+	extern vk::Sampler noiseSampler;
+
+	extern vk::Image clipmap; // distance clipmap around the camera, its levels stacked along z, see clipmap.glsl
+	extern vk::DeviceMemory clipmapMemory;
+	extern vk::ImageView clipmapView;
 
 	extern vk::DescriptorSetLayout mainDescriptorLayout;
 	extern vk::PipelineLayout mainPipelineLayout;
 	extern vk::Pipeline mainPipeline;
+	extern vk::Pipeline resolvePipeline; // fills in pixels skipped by interleaved compute marching
+	extern vk::Pipeline conePipeline; // low resolution pre-pass finding where compute marching can start
+	extern vk::Pipeline shadePipeline; // lights the g-buffer written by compute marching and queues bounces
+	extern vk::Pipeline bouncePipeline; // traces one level of queued bounce rays
+	extern vk::Pipeline compositePipeline; // blends traced bounces into the shaded pixels
+	extern vk::Pipeline upsamplePipeline; // spreads reduced resolution bounces over the untraced pixels
+	extern vk::Pipeline bakePipeline; // bakes static subtrees into the brick cache
+	extern vk::Pipeline clipmapPipeline; // updates a box of clipmap texels
 
 	extern vk::DescriptorSetLayout uiDescriptorLayout;
 	extern vk::PipelineLayout uiPipelineLayout;
@@ -47,10 +118,12 @@ namespace Primrose {
 	struct SwapchainFrame {
 		vk::Image image; // gpu image handle
 		vk::ImageView imageView; // interface for image
+		vk::ImageView storageView; // what the trace shaders write through, a unorm view of srgb images
 		vk::Framebuffer framebuffer; // render pass target used to draw to image
 	};
 	extern std::vector<SwapchainFrame> swapchainFrames;
 	extern vk::Format swapchainImageFormat; // pixel format used in swapchain
+	extern vk::Format swapchainStorageFormat; // format of SwapchainFrame::storageView, when tracing directly
 	extern vk::Extent2D swapchainExtent; // resolution of swapchain
 
 	extern int windowWidth;
@@ -70,6 +143,12 @@ namespace Primrose {
 		vk::Semaphore renderFinishedSemaphore;
 		vk::Fence inFlightFence;
 
+		vk::QueryPool timestampPool; // start and end of the frame on the gpu
+		bool timestampsWritten = false;
+
+		vk::Buffer statsBuffer; // MarchStats of the frame, only on the compute backend
+		vk::DeviceMemory statsBufferMemory;
+
 //		vk::DescriptorSet descriptorSet; // descriptor set for uniforms
 		vk::Buffer uniformBuffer; // buffer for ubo
 		vk::DeviceMemory uniformBufferMemory; // memory for ubo
@@ -113,7 +192,14 @@ namespace Primrose {
 	void createSwapchain();
 	void createRenderPass();
 	void createSwapchainFrames();
+	void chooseStorageExtent();
 	void createTraceImage();
+	void createHistoryImages();
+	void createConeImage();
+	void createBounceQueue();
+	void createBrickCache();
+	void createClipmap();
+	void createNoiseVolume();
 //	void createDescriptorSetLayout();
 
 	void createUIPipeline();
@@ -121,6 +207,7 @@ namespace Primrose {
 	void createDitherTexture();
 
 	void createCommandPool();
+	void createPipelineCache();
 //	void createDescriptorPool();
 	void createFramesInFlight();
 
@@ -128,6 +215,8 @@ namespace Primrose {
 
 	void cleanupSwapchain();
 	void recreateSwapchain();
+	void releaseRetiredSwapchains();
+	void recreatePipelines();
 
 	// other vulkan
 //	void allocateDescriptorSet(vk::DescriptorSet* descSet);
@@ -137,6 +226,7 @@ namespace Primrose {
 	void createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties,
 		vk::Buffer* buffer, vk::DeviceMemory* bufferMemory, bool deviceAddressFlag = false);
 	void writeToDevice(vk::DeviceMemory memory, const void* data, size_t size, size_t offset = 0);
+	void readFromDevice(vk::DeviceMemory memory, void* data, size_t size, size_t offset = 0);
 
 	void transitionImageLayout(vk::Image image, vk::CommandBuffer cmd,
 	vk::ImageLayout oldLayout, vk::AccessFlags oldAccess, vk::PipelineStageFlags oldStage,
@@ -145,15 +235,22 @@ namespace Primrose {
 
 	void importTexture(const char* path, vk::Image* image, vk::DeviceMemory* imageMemory, float* aspect = nullptr);
 
-	void imageFromData(void* data, uint32_t width, uint32_t height, vk::Image* image, vk::DeviceMemory* imageMemory);
+	void imageFromData(void* data, uint32_t width, uint32_t height, vk::Image* image, vk::DeviceMemory* imageMemory,
+		vk::Format format = vk::Format::eR8G8B8A8Srgb);
+
+	vk::ImageView createImageView(vk::Image image, vk::Format format, vk::ImageUsageFlags usage = {});
 
-	vk::ImageView createImageView(vk::Image image, vk::Format format);
+	void createStorageImage(vk::Format format, vk::Extent2D extent, StorageImage* image);
+	void destroyStorageImage(StorageImage& image);
 
 	vk::CommandBuffer startSingleTimeCommandBuffer();
 	void endSingleTimeCommandBuffer(vk::CommandBuffer cmdBuffer);
 
 	vk::ShaderModule createShaderModule(const uint32_t* code, size_t length);
-	vk::ShaderModule compileShaderModule(const char* code);
+	// compiles glsl with shaderc, resolving #include by file name from includes, and caches the spir-v
+	vk::ShaderModule compileShaderModule(const std::string& code, vk::ShaderStageFlagBits stage,
+		const std::map<std::string, std::string>& includes = {});
+	void trimShaderCache(); // forgets the spir-v compileShaderModule hasn't returned since the last trim
 }
 
 #endif
@@ -30,20 +30,20 @@ namespace Primrose {
 		const glm::vec3& getMax();
 
 		bool isEmpty();
+		float surfaceArea(); // 0 if empty
 
 		void addPoint(glm::vec3 p); // extends aabb to include point
 		void applyTransform(glm::mat4 transform); // apply transformation to aabb
 
 		void unionWith(AABB aabb);
 		void intersectWith(AABB aabb);
+		bool contains(glm::vec3 p);
 
 		vk::AabbPositionsKHR toVkStruct();
 
 	private:
 		std::vector<glm::vec3> getCorners();
 
-		bool contains(glm::vec3 p);
-
 		glm::vec3 min = glm::vec3(NAN);
 		glm::vec3 max = glm::vec3(NAN);
 	};
@@ -23,8 +23,10 @@ namespace Primrose {
 		void accept(NodeVisitor* visitor) override;
 		void serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer) override;
 
-		std::string generateIntersectionGlsl() override;
-		AABB generateAabb() override;
+		std::string generateIntersectionGlsl(Node* space = nullptr) override;
+		AABB generateAabb(Node* space = nullptr) override;
+		Interval distanceInterval(AABB cell, Node* space = nullptr) override;
+		void generateIntersectionTerms(Node* space, std::vector<IntersectionTerm>& terms) override;
 
 	private:
 		Operation foldOperations(uint i, uint j) override;
@@ -36,8 +38,9 @@ namespace Primrose {
 		void accept(NodeVisitor* visitor) override;
 		void serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer) override;
 
-		std::string generateIntersectionGlsl() override;
-		AABB generateAabb() override;
+		std::string generateIntersectionGlsl(Node* space = nullptr) override;
+		AABB generateAabb(Node* space = nullptr) override;
+		Interval distanceInterval(AABB cell, Node* space = nullptr) override;
 
 	private:
 		Operation foldOperations(uint i, uint j) override;
@@ -49,8 +52,9 @@ namespace Primrose {
 		void accept(NodeVisitor* visitor) override;
 		void serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer) override;
 
-		std::string generateIntersectionGlsl() override;
-		AABB generateAabb() override;
+		std::string generateIntersectionGlsl(Node* space = nullptr) override;
+		AABB generateAabb(Node* space = nullptr) override;
+		Interval distanceInterval(AABB cell, Node* space = nullptr) override;
 
 		std::set<Node*> subtractNodes;
 
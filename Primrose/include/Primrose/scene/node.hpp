@@ -8,6 +8,7 @@
 #include <vector>
 #include <memory>
 #include <set>
+#include <string>
 #include <glm/vec3.hpp>
 #include <rapidjson/writer.h>
 #include <rapidjson/ostreamwrapper.h>
@@ -15,6 +16,16 @@
 namespace Primrose {
 	class NodeVisitor;
 
+	struct IntersectionTerm { // part of a subtree's sdf which is unioned with the others, see generateIntersectionTerms
+		std::string glsl;
+		AABB aabb;
+	};
+
+	struct Interval { // range the sdf takes over a box, see Node::distanceInterval
+		float min;
+		float max;
+	};
+
 	class Node {
 	public:
 		Node(Node* parent);
@@ -32,10 +43,19 @@ namespace Primrose {
 
 		virtual std::string toString(std::string prefix = "");
 		virtual glm::mat4 modelMatrix();
+		glm::mat4 modelMatrix(Node* space); // relative to the ancestor space, or world space if null
 		bool shouldHide();
 
-		virtual std::string generateIntersectionGlsl() = 0;
-		virtual AABB generateAabb() = 0;
+		// relative to the ancestor space like modelMatrix, so repeated subtrees generate identical glsl and bounds
+		virtual std::string generateIntersectionGlsl(Node* space = nullptr) = 0;
+		virtual AABB generateAabb(Node* space = nullptr) = 0;
+		// splits the sdf into terms whose union is generateIntersectionGlsl, so they can be bounded separately
+		virtual void generateIntersectionTerms(Node* space, std::vector<IntersectionTerm>& terms);
+		// conservative range of generateIntersectionGlsl over cell, infinite if the node is hidden
+		virtual Interval distanceInterval(AABB cell, Node* space = nullptr) = 0;
+		// the part of aabb the sdf could be negative in, found by subdividing it with distanceInterval, generateAabb
+		// doesn't call it so a subtree is only subdivided once, by whoever needs its tight bounds
+		AABB tightenAabb(AABB aabb, Node* space = nullptr);
 
 		virtual void accept(NodeVisitor* visitor) = 0;
 
@@ -45,9 +65,13 @@ namespace Primrose {
 		virtual std::vector<Transformation> extractTransforms();
 		virtual bool createOperations(const std::vector<Primitive>& prims,
 			const std::vector<Transformation>& transforms, std::vector<Operation>& ops) = 0;
+		bool appendOperations(const std::vector<Primitive>& prims, const std::vector<Transformation>& transforms,
+			std::vector<Operation>& ops); // createOperations, behind a BRICK operation if the node is baked
 
 		std::string name = "Node";
 		bool hide = false;
+		bool isStatic = false; // never changes, so its distance field can be baked into the brick cache
+		uint brickVolume = -1; // brick cache volume, set by Scene::generateUniforms if the node is baked
 
 		glm::vec3 translate = glm::vec3(0);
 		glm::vec3 scale = glm::vec3(1);
@@ -74,10 +98,13 @@ namespace Primrose {
 		using Node::extractTransforms;
 		bool createOperations(const std::vector<Primitive>& prims, const std::vector<Transformation>& transforms,
 			std::vector<Operation>& ops) override;
+		bool createOperations(const std::vector<Primitive>& prims, const std::vector<Transformation>& transforms,
+			std::vector<Operation>& ops, std::vector<AABB>* groupAabbs); // bounds of each RENDER group, in order
 		glm::mat4 modelMatrix() override;
 
-		std::string generateIntersectionGlsl() override;
-		AABB generateAabb() override;
+		std::string generateIntersectionGlsl(Node* space = nullptr) override;
+		AABB generateAabb(Node* space = nullptr) override;
+		Interval distanceInterval(AABB cell, Node* space = nullptr) override;
 
 		bool isDescendantOf(Primrose::Node *ancestor) override;
 
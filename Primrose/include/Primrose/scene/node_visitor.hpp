@@ -13,6 +13,8 @@ namespace Primrose {
 		virtual void visit(TorusNode*) = 0;
 		virtual void visit(LineNode*) = 0;
 		virtual void visit(CylinderNode*) = 0;
+		virtual void visit(NoiseRockNode*) = 0;
+		virtual void visit(NoiseTerrainNode*) = 0;
 		virtual void visit(UnionNode*) = 0;
 		virtual void visit(IntersectionNode*) = 0;
 		virtual void visit(DifferenceNode*) = 0;
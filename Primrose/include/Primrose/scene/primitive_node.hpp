@@ -10,10 +10,11 @@ public: \
 std::string toString(std::string prefix = "") override; \
 void accept(NodeVisitor* visitor) override; \
 void serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer) override; \
-std::string generateIntersectionGlsl() override; \
-AABB generateAabb() override; \
 private: \
-Primitive toPrimitive() override;
+Primitive toPrimitive() override; \
+std::string primitiveGlsl(Node* space) override; \
+AABB primitiveAabb(Node* space) override; \
+float primitiveDistance(glm::vec3 p) override;
 
 namespace Primrose {
 	class PrimitiveNode : public UnionNode {
@@ -22,8 +23,11 @@ namespace Primrose {
 
 		void serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer) override = 0;
 
-		std::string generateIntersectionGlsl() override = 0;
-		AABB generateAabb() override = 0;
+		// the primitive unioned with its children
+		std::string generateIntersectionGlsl(Node* space = nullptr) override;
+		AABB generateAabb(Node* space = nullptr) override;
+		void generateIntersectionTerms(Node* space, std::vector<IntersectionTerm>& terms) override;
+		Interval distanceInterval(AABB cell, Node* space = nullptr) override;
 
 		std::vector<Primitive> extractPrims() override;
 		std::vector<Transformation> extractTransforms() override;
@@ -31,8 +35,18 @@ namespace Primrose {
 			const std::vector<Primitive>& prims, const std::vector<Transformation>& transforms,
 			std::vector<Operation>& ops) override;
 
+	protected:
+		// glsl of function(p in primitive space args)
+		std::string placeGlsl(Node* space, std::string function, std::string args = "");
+		AABB placeAabb(Node* space, AABB local); // local aabb of the primitive, transformed
+
 	private:
 		virtual Primitive toPrimitive() = 0;
+		virtual std::string primitiveGlsl(Node* space) = 0; // the primitive alone, without its children
+		virtual AABB primitiveAabb(Node* space) = 0;
+		virtual float primitiveDistance(glm::vec3 p) = 0; // primitiveGlsl in primitive space, 1-lipschitz
+		// how far primitiveGlsl can be from primitiveDistance, for surfaces the cpu can't evaluate
+		virtual float primitiveSlack() { return 0.f; }
 	};
 
 	class SphereNode : public PrimitiveNode { PRIM_OVERRIDES
@@ -66,6 +80,24 @@ namespace Primrose {
 		CylinderNode(Node* parent, float radius);
 		float radius;
 	};
+
+	class NoiseRockNode : public PrimitiveNode { PRIM_OVERRIDES
+	public:
+		NoiseRockNode(Node* parent, float height, float frequency);
+		float height;
+		float frequency;
+	private:
+		float primitiveSlack() override;
+	};
+
+	class NoiseTerrainNode : public PrimitiveNode { PRIM_OVERRIDES
+	public:
+		NoiseTerrainNode(Node* parent, float height, float frequency);
+		float height;
+		float frequency;
+	private:
+		float primitiveSlack() override;
+	};
 }
 
 #endif
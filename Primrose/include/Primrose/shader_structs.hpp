@@ -49,6 +49,7 @@ namespace Primrose {
 		IDENTITY = 904,
 		TRANSFORM = 905,
 		RENDER = 906,
+		BRICK = 907,
 	};
 
 	enum OP_FLAG : uint {
@@ -67,6 +68,27 @@ namespace Primrose {
 	extern std::map<OP_FLAG, std::string> OP_FLAG_NAMES;
 	extern std::map<UI, std::string> UI_NAMES;
 
+	enum class QUALITY : uint {
+		LOW = 0,
+		MEDIUM = 1,
+		HIGH = 2,
+	};
+	extern std::map<QUALITY, std::string> QUALITY_NAMES;
+
+	struct QualitySettings { // specialization constants of the marching shaders, see constants.glsl
+		int maxMarches; // constant_id 0
+		uint maxBounces; // at most MAX_BOUNCE_LEVELS
+		float hitMargin;
+		float normalEps;
+		float maxDist;
+		vk::Bool32 debugBackground; // checkerboard background
+
+		static QualitySettings preset(QUALITY quality);
+		vk::SpecializationInfo specializationInfo() const; // points into this struct
+
+		bool operator==(const QualitySettings& settings) const = default;
+	};
+
 	struct Operation {
 		alignas(4) OP type; // OP:: prefix
 		alignas(4) uint i = 0; // index of first operand
@@ -74,13 +96,16 @@ namespace Primrose {
 		alignas(4) OP_FLAG flags;
 
 		static Operation Identity(uint i, uint j, OP_FLAG flags = OP_FLAG::NONE) { return {OP::IDENTITY, i, j, flags}; };
-		static Operation Render(uint i, OP_FLAG flags = OP_FLAG::NONE) { return {OP::RENDER, i, 0, flags}; };
+		static Operation Render(uint i, uint groupStart, OP_FLAG flags = OP_FLAG::NONE)
+			{ return {OP::RENDER, i, groupStart, flags}; };
 		static Operation Transform(uint i, OP_FLAG flags = OP_FLAG::NONE) { return {OP::TRANSFORM, i, 0, flags}; };
 		static Operation Union(uint i, uint j, OP_FLAG flags = OP_FLAG::NONE) { return {OP::UNION, i, j, flags}; };
 		static Operation Intersection(uint i, uint j, OP_FLAG flags = OP_FLAG::NONE)
 			{ return {OP::INTERSECTION, i, j, flags}; };
 		static Operation Difference(uint i, uint j, OP_FLAG flags = OP_FLAG::NONE)
 			{ return {OP::DIFFERENCE, i, j, flags}; };
+		static Operation Brick(uint volume, uint end, OP_FLAG flags = OP_FLAG::NONE)
+			{ return {OP::BRICK, volume, end, flags}; };
 	};
 
 	struct Primitive {
@@ -94,12 +119,17 @@ namespace Primrose {
 		static Primitive Torus(float ringRadius) { return {PRIM::TORUS, ringRadius}; };
 		static Primitive Line(float halfHeight) { return {PRIM::LINE, halfHeight}; };
 		static Primitive Cylinder() { return {PRIM::CYLINDER}; };
+		// procedural surfaces displaced by the noise volume, frequency in its smooth texels per unit
+		static Primitive NoiseRock(float height, float frequency) { return {PRIM::P5, height, frequency}; };
+		static Primitive NoiseTerrain(float height, float frequency) { return {PRIM::P6, height, frequency}; };
 
 		bool operator==(const Primitive& p) const {
 			if (type == PRIM::SPHERE || type == PRIM::BOX || type == PRIM::CYLINDER) {
 				return type == p.type;
 			} else if (type == PRIM::TORUS || type == PRIM::LINE) {
 				return type == p.type && a == p.a;
+			} else if (type == PRIM::P5 || type == PRIM::P6) {
+				return type == p.type && a == p.a && b == p.b;
 			} else {
 				throw std::runtime_error(fmt::format(
 					"Primitive operator== not defined for type {}", static_cast<uint>(p.type)));
@@ -108,7 +138,7 @@ namespace Primrose {
 	};
 
 	struct Transformation {
-		alignas(16) glm::mat4 invMatrix;
+		alignas(4) glm::mat4 invMatrix; // tightly packed to match the scalar uniform layout
 		alignas(4) float smallScale;
 
 		Transformation() = default;
@@ -119,13 +149,22 @@ namespace Primrose {
 		}
 	};
 
+	struct Bounds {
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
 	struct ModelAttributes {
 		glm::mat4 invMatrix;
 		float invScale;
 		glm::vec3 aabbMin;
 		glm::vec3 aabbMax;
+		uint part; // which part of its blas' sdf the aabb bounds
 	};
 
+	const uint MAX_CLIPMAP_LEVELS = 8; // keep in sync with constants.glsl
+	static_assert(MAX_CLIPMAP_LEVELS == 8, "structs.glsl sizes clipmapOrigins with a literal 8");
+
 	struct MarchUniforms {
 		glm::vec3 camPos = glm::vec3(0);
 		glm::vec3 camDir = glm::vec3(0, 0, 1);
@@ -134,20 +173,78 @@ namespace Primrose {
 
 		float focalLength;
 		float invZoom;
-
-		ModelAttributes attributes[100];
-		uint geometryAttributeOffset[100];
+		float relaxation = 1.f; // over-relaxation factor of sphere tracing steps, 1 for plain sphere tracing
 
 		uint numOperations;
 		Operation operations[100];
 		Primitive primitives[100];
 		Transformation transformations[100];
+		Bounds renderBounds[100]; // world space bounds of each RENDER group, indexed by operation
+
+		// camera of the last frame, for reprojection
+		glm::vec3 prevCamPos = glm::vec3(0);
+		glm::vec3 prevCamDir = glm::vec3(0, 0, 1);
+		glm::vec3 prevCamUp = glm::vec3(0, 1, 0);
+
+		// distance clipmap around the camera, see clipmap.glsl
+		glm::ivec3 clipmapOrigins[MAX_CLIPMAP_LEVELS]; // first texel of each level, in the level's texels
+		float clipmapTexel = 0; // texel size of the finest level
+		uint clipmapLevels = 0; // 0 when there is no clipmap
 
 		std::string toString();
 	};
 
 	struct PushConstants {
 		float time;
+		uint encodeSrgb; // bool, set when the output image is linear but displayed as srgb
+		glm::uvec2 extent; // resolution being marched, the output image can be larger
+		uint frameIndex;
+		uint historyValid; // bool, whether last frame's history images match this frame's extent and scene
+		uint historyRefresh; // frames a reprojected pixel is reused before it is shaded again, 0 to never reuse
+		uint interleave; // 1, 2 or 4, one in this many pixels is marched per frame and the rest are reconstructed
+		uint bounceScale; // 1, 2 or 4, bounces are traced for one in this many pixels per axis and upsampled
+		uint bounceLevel; // bounce level traced by a bounce.comp dispatch
+	};
+
+	const uint MAX_BOUNCE_LEVELS = 5; // most bounces QualitySettings can ask for, keep in sync with constants.glsl
+
+	struct BounceCounters { // state of the wavefront bounce queue, reset by the engine before each frame
+		uint capacity; // rays that fit in the bounce ray buffer
+		uint allocated = 0;
+		std::array<uint, MAX_BOUNCE_LEVELS + 1> levelCounts{}; // rays queued per bounce level, level 0 unused
+		std::array<vk::DispatchIndirectCommand, MAX_BOUNCE_LEVELS + 1> levelGroups; // bounce.comp indirect dispatches
+	};
+
+	const uint NOISE_VOLUME_SIZE = 64; // texels per side of the noise volume
+	const uint NOISE_COARSE_PERIOD = 16; // lattice spacing in texels of each channel, keep in sync with noise.glsl
+	const uint NOISE_DETAIL_PERIOD = 4;
+
+	const uint MAX_BRICK_VOLUMES = 8; // static subtrees that can be baked at once, keep in sync with bricks.glsl
+	const uint BRICK_SIZE = 8; // distance samples per side of a brick
+	const uint BRICK_ATLAS_BRICKS = 16; // bricks per side of the atlas, so it holds BRICK_ATLAS_BRICKS^3 bricks
+
+	struct BrickVolume { // grid of cells over a baked subtree, scalar layout
+		glm::vec3 min; // corner of the grid, which is padded by a cell on every side of the subtree's bounds
+		float cellSize; // world size of a cell, each cell is either empty or covered by one brick
+		glm::uvec3 dims; // cells per axis
+		uint firstCell; // index of the grid's first cell in the brick cache
+	};
+
+	struct BrickCacheHeader { // start of the brick cache buffer, the cells of every volume follow it
+		uint capacity; // bricks that fit in the atlas
+		uint allocated = 0; // bricks handed out by the bake, can overshoot the capacity
+		BrickVolume volumes[MAX_BRICK_VOLUMES];
+	};
+
+	struct BrickCell {
+		uint brick; // brick in the atlas, or one of the NO_BRICK markers in bricks.glsl
+		float dist; // lower bound of the distance anywhere in an empty cell
+	};
+
+	struct MarchStats { // written by march.comp, read back once the frame's fence is signalled
+		uint steps; // sphere tracing steps over every march of every pixel
+		uint rays; // pixels marched
+		uint bouncesQueued; // bounce rays allocated, copied from BounceCounters, past the capacity they were dropped
 	};
 
 	struct UIVertex {
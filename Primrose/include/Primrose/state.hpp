@@ -18,12 +18,43 @@ namespace Primrose {
 	extern float currentTime;
 	extern float deltaTime;
 
+	extern float targetFrameTime; // gpu milliseconds per frame the render scale aims for, 0 for full resolution
+	extern float renderScale; // fraction of the swapchain resolution the scene is marched at
+
+	extern unsigned int frameIndex; // frames drawn since startup
+	extern bool historyValid; // whether the temporal history holds last frame's view of the current scene
+	extern vk::Extent2D historyExtent; // render extent the history was marched at, history is only reused at it
+	extern unsigned int historyRefresh; // frames a reprojected pixel is reused before it is shaded again
+	extern unsigned int interleave; // 1, 2 or 4, one in this many pixels is marched per frame, see setInterleave
+	extern QualitySettings quality; // specialization constants of the marching pipelines, see setQualityPreset
+	extern unsigned int bounceScale; // 1, 2 or 4, bounces are traced at this fraction of the resolution per axis
+	extern float marchStepsPerPixel; // average sphere tracing steps of a marched pixel, only on the compute backend
+	extern unsigned int droppedBounces; // bounce rays that didn't fit in the queue last frame, see Settings::bounceBudget
+
 	extern bool windowResized;
 	extern bool windowMinimized;
 	extern bool windowFocused;
 
 	extern MarchUniforms uniforms;
 
+	struct StaticSubtree { // program of a static node, baked into the brick cache by bakeBricks
+		BrickVolume volume;
+		std::vector<Operation> operations; // the subtree alone, ending in its render operation
+		std::string key; // operations with their primitives and transforms resolved, to tell when it changes
+	};
+	extern std::vector<StaticSubtree> staticSubtrees; // set by Scene::generateUniforms
+	extern bool bricksBaked; // whether the brick cache holds staticSubtrees
+	extern bool clipmapValid; // whether the clipmap holds the current scene, otherwise every level is updated
+
+	struct StructureMemory { // bytes of device memory held by the acceleration structures, only when ray accelerated
+		size_t bottom = 0; // every blas, after compaction
+		size_t bottomUncompacted = 0; // what the blas would hold without compaction
+		size_t top = 0;
+		size_t scratch = 0; // build scratch shared by every structure
+		size_t instances = 0; // instances of the top structure
+	};
+	extern StructureMemory structureMemory;
+
 	extern std::vector<std::unique_ptr<UIElement>> uiScene;
 
 	// engine constants
@@ -53,6 +84,21 @@ namespace Primrose {
 
 		extern const bool validationEnabled;
 
+		extern const bool traceToSwapchain;
+		extern const bool preferComputeMarch;
+		extern const float minRenderScale;
+		extern const float relaxation;
+		extern const float bounceBudget;
+		extern const QUALITY qualityPreset;
+		extern const uint brickResolution;
+		extern const uint clipmapResolution;
+		extern const uint clipmapLevels;
+		extern const float clipmapTexel;
+		extern const bool compactStructures;
+		extern const uint maxTopRefits;
+		extern const float aabbSplitCost;
+		extern const uint boundsSubdivisions;
+
 		extern const int MAX_NUM_PRIMITIVES;
 		extern const int MAX_NUM_OPERATIONS;
 
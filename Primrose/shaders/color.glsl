@@ -0,0 +1,9 @@
+#ifndef COLOR_GLSL
+#define COLOR_GLSL
+
+vec3 linearToSrgb(vec3 c) {
+	c = clamp(c, 0.0, 1.0);
+	return mix(c * 12.92, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, c));
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef BOUNCE_GLSL
+#define BOUNCE_GLSL
+
+// wavefront queue of secondary rays, traced one bounce level per dispatch by bounce.comp
+// included before march.glsl, so renderMaterial appends its rays here instead of to a local array
+// rays of a level are allocated contiguously, after every ray of the levels before it
+
+#define BOUNCE_QUEUE
+
+const uint NO_RAY = -1;
+const uint BOUNCE_GROUP_SIZE = 64; // bounce.comp workgroup size, keep in sync with the engine
+
+struct BounceRay { // 48 bytes, keep in sync with BOUNCE_RAY_SIZE
+	vec3 pos;
+	uint pixel; // x | y << 16
+	vec3 dir;
+	uint next; // next ray of the same pixel, NO_RAY at the end of the list
+	uint insideMat;
+	uint order; // level << 8 | path, sorting by it gives the order the fragment path bounces in
+	uvec2 color; // half floats, rgb of the lit surface and the ray's strength, 0 if it missed
+};
+
+struct DispatchArgs {
+	uint x;
+	uint y;
+	uint z;
+};
+
+layout(binding = 11, std430) buffer BounceRays {
+	BounceRay bounceRays[];
+};
+
+layout(binding = 12, std430) buffer BounceCounters { // reset by the engine before each frame
+	uint bounceCapacity; // rays that fit in bounceRays
+	uint bounceAllocated; // rays allocated so far, can overshoot the capacity
+	uint levelCounts[MAX_BOUNCE_LEVELS + 1]; // rays queued per level, level 0 is the primary ray and unused
+	DispatchArgs levelGroups[MAX_BOUNCE_LEVELS + 1]; // bounce.comp workgroups per level, read by the indirect dispatch
+};
+
+// per pixel linked list of queued rays, and how many the pixel has queued
+layout(binding = 13, r32ui) uniform coherent uimage2D bounceHeadImage;
+layout(binding = 14, r32ui) uniform coherent uimage2D bounceCountImage;
+
+// blended bounces of each pixel, the final colour is primary * a + rgb, a is negative for reused pixels
+layout(binding = 15, rgba16f) uniform image2D bounceImage;
+
+// the surface being shaded, set before calling renderMaterial
+ivec2 bouncePixel;
+uint bounceOrder = 0; // order of the ray that hit it, 0 for the primary ray
+uint bounceChildren = 0; // rays it has pushed
+bool bounceTraced = true; // false when the pixel's bounces are upsampled from its neighbours instead
+
+uint bounceLevel(uint order) {
+	return order >> 8;
+}
+
+void pushBounce(Bounce bounce) {
+	uint level = bounceLevel(bounceOrder) + 1;
+	if (!bounceTraced || level > MAX_BOUNCES) return;
+	if (imageAtomicAdd(bounceCountImage, bouncePixel, 1u) >= MAX_BOUNCES) return; // pixel used up its bounces
+
+	uint index = atomicAdd(bounceAllocated, 1u);
+	if (index >= bounceCapacity) return; // frame's budget is spent, the ray is dropped and counted by the engine
+
+	// the thread opening a workgroup's worth of rays adds the workgroup
+	uint levelIndex = atomicAdd(levelCounts[level], 1u);
+	if (levelIndex % BOUNCE_GROUP_SIZE == 0) atomicAdd(levelGroups[level].x, 1u);
+
+	BounceRay ray;
+	ray.pos = bounce.ray.pos;
+	ray.pixel = uint(bouncePixel.x) | (uint(bouncePixel.y) << 16);
+	ray.dir = bounce.ray.dir;
+	ray.insideMat = bounce.insideMat;
+	ray.order = (level << 8) | ((bounceOrder & 0xffu) << 1) | bounceChildren; // refraction before reflection
+	ray.color = uvec2(0, packHalf2x16(vec2(0, bounce.strength)));
+	ray.next = imageAtomicExchange(bounceHeadImage, bouncePixel, index);
+	bounceRays[index] = ray;
+
+	bounceChildren += 1;
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef BRICKS_GLSL
+#define BRICKS_GLSL
+
+// sparse cache of the distance fields of static subtrees, baked by bake.comp whenever they change
+// each volume is a grid of cells over its subtree, cells near the surface point to a brick of samples in the atlas
+// and the rest hold a lower bound of the distance, so a step costs one lookup instead of the subtree's operations
+// included before march.glsl, which then skips the operations of OP_BRICK subtrees while stepping
+
+#define BRICK_CACHE
+
+const uint MAX_BRICK_VOLUMES = 8; // keep in sync with the engine
+const uint BRICK_SIZE = 8; // samples per side of a brick, spanning its cell corner to corner
+const uint BRICK_ATLAS_BRICKS = 16; // bricks per side of the atlas
+
+const uint NO_BRICK = -1; // cell is far from the surface, its dist is a lower bound of the distance inside it
+const uint BRICK_EXACT = -2; // cell needed a brick once the atlas was full, the subtree's operations are used
+
+struct BrickVolume {
+	vec3 min; // grid corner, the grid is padded by one cell around the subtree's bounds
+	float cellSize;
+	uvec3 dims;
+	uint firstCell;
+};
+
+struct BrickCell {
+	uint brick;
+	float dist;
+};
+
+layout(binding = 16) uniform sampler3D brickAtlas; // r16f, BRICK_ATLAS_BRICKS^3 bricks
+
+layout(binding = 17, scalar) buffer BrickCache { // written by bake.comp and the engine
+	uint brickCapacity;
+	uint bricksAllocated; // can overshoot the capacity
+	BrickVolume brickVolumes[MAX_BRICK_VOLUMES];
+	BrickCell brickCells[];
+};
+
+uvec3 brickSlot(uint brick) { // brick's corner in the atlas, in bricks
+	return uvec3(brick % BRICK_ATLAS_BRICKS, (brick / BRICK_ATLAS_BRICKS) % BRICK_ATLAS_BRICKS,
+		brick / (BRICK_ATLAS_BRICKS * BRICK_ATLAS_BRICKS));
+}
+
+// baked distance to a volume's subtree, false if the subtree has to be evaluated instead
+bool brickDistance(vec3 p, uint volume, out float d) {
+	BrickVolume v = brickVolumes[volume];
+	vec3 local = (p - v.min) / v.cellSize;
+
+	if (any(lessThan(local, vec3(0))) || any(greaterThanEqual(local, vec3(v.dims)))) {
+		// outside the grid, the subtree lies within its unpadded bounds
+		vec3 inner = clamp(p, v.min + v.cellSize, v.min + (vec3(v.dims) - 1.f) * v.cellSize);
+		d = distance(p, inner);
+		return true;
+	}
+
+	uvec3 cell = uvec3(local);
+	BrickCell c = brickCells[v.firstCell + (cell.z * v.dims.y + cell.y) * v.dims.x + cell.x];
+	if (c.brick == BRICK_EXACT) return false;
+	if (c.brick == NO_BRICK) {
+		d = c.dist;
+		return true;
+	}
+
+	// trilinear between the samples, which sit on texel centres from the brick's first to its last texel
+	vec3 texel = vec3(brickSlot(c.brick) * BRICK_SIZE) + 0.5f + (local - vec3(cell)) * float(BRICK_SIZE - 1);
+	d = textureLod(brickAtlas, texel / float(BRICK_SIZE * BRICK_ATLAS_BRICKS), 0).r;
+	return true;
+}
+
+#endif
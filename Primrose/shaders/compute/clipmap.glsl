@@ -0,0 +1,37 @@
+#ifndef CLIPMAP_GLSL
+#define CLIPMAP_GLSL
+
+// nested distance volumes around the camera, each level doubles the texel size of the one inside it
+// a texel holds the scene's unsigned distance at its centre, levels are stacked along z and addressed toroidally
+// so the engine only has to update the slabs of texels the camera moved into, see clipmap.comp
+// included after the `u` uniforms macro, march.glsl then steps through it while far from every surface
+
+#define CLIPMAP
+
+layout(binding = 19, r32f) uniform image3D clipmapImage;
+
+ivec3 clipmapCoord(ivec3 texel, uint level) { // image coordinate of a level's texel, given in world texels
+	int size = imageSize(clipmapImage).x;
+	return ((texel % size) + size) % size + ivec3(0, 0, int(level) * size);
+}
+
+// lower bound of the distance to the scene at p, or -1 where it should be evaluated exactly instead,
+// ie outside the clipmap or within a texel of a surface
+float clipmapDistance(vec3 p) {
+	int size = imageSize(clipmapImage).x;
+	float texelSize = u.clipmapTexel;
+
+	for (uint level = 0; level < u.clipmapLevels; ++level, texelSize *= 2.f) {
+		ivec3 texel = ivec3(floor(p / texelSize));
+		ivec3 local = texel - u.clipmapOrigins[level];
+		if (any(lessThan(local, ivec3(0))) || any(greaterThanEqual(local, ivec3(size)))) continue;
+
+		// p is within half a texel diagonal of the sample
+		float bound = imageLoad(clipmapImage, clipmapCoord(texel, level)).r - texelSize * 0.8660254f;
+		return bound >= texelSize ? bound : -1.f;
+	}
+
+	return -1.f;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef GBUFFER_GLSL
+#define GBUFFER_GLSL
+
+// primary hit of each pixel, written by march.comp and shaded by shade.comp
+// depth is kept in the depth image, the normal, material and group are packed into one rg32ui texel
+
+vec2 octEncode(vec3 n) { // unit vector to the [-1, 1] square
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 e = n.xy;
+	if (n.z < 0) e = (1 - abs(n.yx)) * mix(vec2(-1), vec2(1), greaterThanEqual(n.xy, vec2(0)));
+	return e;
+}
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0);
+	n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0)));
+	return normalize(n);
+}
+
+uvec2 packSurface(vec3 normal, uint mat, uint group) {
+	return uvec2(packSnorm2x16(octEncode(normal)), (mat & 0xffffu) | (group << 16));
+}
+void unpackSurface(uvec2 texel, out vec3 normal, out uint mat, out uint group) {
+	normal = octDecode(unpackSnorm2x16(texel.x));
+	mat = texel.y & 0xffffu;
+	group = texel.y >> 16;
+	if (mat == 0xffffu) mat = NO_MAT;
+	if (group == 0xffffu) group = NO_GROUP;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef INTERLEAVE_GLSL
+#define INTERLEAVE_GLSL
+
+// pixels marched each frame when interleaving, the rest are reconstructed by resolve.comp
+// 1: every pixel, 2: checkerboard alternating every frame, 4: one pixel of each 2x2 block, rotating
+
+const uvec2 QUARTER_OFFSETS[4] = { uvec2(0, 0), uvec2(1, 1), uvec2(1, 0), uvec2(0, 1) }; // diagonal first
+
+uvec2 interleaveScale(uint interleave) { // marched pixels per thread in each direction
+	return uvec2(interleave == 1 ? 1 : 2, interleave == 4 ? 2 : 1);
+}
+
+ivec2 interleavedPixel(uvec2 id, uint interleave, uint frame) { // pixel marched by a compacted thread id
+	if (interleave == 2) return ivec2(id.x * 2 + ((id.y + frame) & 1), id.y);
+	if (interleave == 4) return ivec2(id * 2 + QUARTER_OFFSETS[frame % 4]);
+	return ivec2(id);
+}
+
+bool isMarched(ivec2 pixel, uint interleave, uint frame) {
+	if (interleave == 2) return ((pixel.x + pixel.y + frame) & 1) == 0;
+	if (interleave == 4) return uvec2(pixel & 1) == QUARTER_OFFSETS[frame % 4];
+	return true;
+}
+
+// bounces are traced by one thread of each scale x scale block of compacted ids, rotating between frames,
+// the rest take them from their neighbours, see upsample.comp
+uvec2 bounceOffset(uint scale, uint frame) {
+	if (scale == 2) return QUARTER_OFFSETS[frame % 4];
+	if (scale == 4) return QUARTER_OFFSETS[frame % 4] * 2 + QUARTER_OFFSETS[(frame / 4) % 4];
+	return uvec2(0);
+}
+
+bool tracesBounces(uvec2 id, uint scale, uint frame) {
+	return id % scale == bounceOffset(scale, frame);
+}
+
+#endif
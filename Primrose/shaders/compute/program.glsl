@@ -0,0 +1,26 @@
+#ifndef PROGRAM_GLSL
+#define PROGRAM_GLSL
+
+// scene program cached per workgroup in shared memory, every invocation reads it many times per step
+// included after the `u` uniforms macro and before march.glsl
+
+shared Operation tileOperations[MAX_OPERATIONS];
+shared Primitive tilePrimitives[MAX_OPERATIONS];
+shared Transformation tileTransformations[MAX_OPERATIONS];
+
+#define OPERATION(i) tileOperations[i]
+#define PRIMITIVE(i) tilePrimitives[i]
+#define TRANSFORMATION(i) tileTransformations[i]
+
+void cacheProgram() { // called by every invocation of the workgroup, followed by a barrier
+	uint threads = gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z;
+	uint numOperations = min(u.numOperations, MAX_OPERATIONS);
+
+	for (uint i = gl_LocalInvocationIndex; i < MAX_OPERATIONS; i += threads) {
+		tilePrimitives[i] = u.primitives[i];
+		tileTransformations[i] = u.transformations[i];
+		if (i < numOperations) tileOperations[i] = u.operations[i];
+	}
+}
+
+#endif
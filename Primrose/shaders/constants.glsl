@@ -6,8 +6,8 @@ const uint PRIM_P1 = 101;
 const uint PRIM_P2 = 102;
 const uint PRIM_P3 = 103;
 const uint PRIM_P4 = 104;
-const uint PRIM_P5 = 105;
-const uint PRIM_P6 = 106;
+const uint PRIM_P5 = 105; // a(height) b(frequency) noise rock, textured counterpart of PRIM_P1
+const uint PRIM_P6 = 106; // a(height) b(frequency) noise terrain, ground plane raised by noise
 const uint PRIM_P7 = 107;
 const uint PRIM_P8 = 108;
 const uint PRIM_P9 = 109;
@@ -22,23 +22,36 @@ const uint OP_INTERSECTION = 902; // i(op) union j(op)
 const uint OP_DIFFERENCE = 903; // i(op) - j(op)
 const uint OP_IDENTITY = 904; // i(prim) identity
 const uint OP_TRANSFORM = 905; // fragment position transformed by i(matrix)
-const uint OP_RENDER = 906; // draw i(op) to screen
+const uint OP_RENDER = 906; // draw i(op) to screen, j(op) is the first operation of its group
+const uint OP_BRICK = 907; // i(volume) baked copy of the operations after it, up to j(op) which holds their result
 
 // constants
 const vec3 BG_COLOR = vec3(0.01f, 0.01f, 0.01f);
 const float MIN_DIST = 0.1f;
-const float MAX_DIST = 10000.f;
-const float HIT_MARGIN = 0.001f;
-const float NORMAL_EPS = 0.0001f; // small epsilon for normal calculations
 const uint NO_MAT = -1;
+const uint NO_GROUP = -1;
+const float NO_MOTION = 65504.f; // largest half float, motion vector of a pixel not visible last frame
 
-const int MAX_MARCHES = 100;
-const uint MAX_BOUNCES = 5;
+const uint MAX_OPERATIONS = 100; // size of the operation, primitive and transformation uniform arrays
+const int CONE_CELL_SIZE = 8; // width and height in pixels of a cone.comp cell, keep in sync with the engine
+const uint MAX_CLIPMAP_LEVELS = 8; // size of the clipmap origins uniform array, keep in sync with the engine
+
+// quality, specialization constants set from the engine's QualitySettings, defaults match QUALITY::HIGH
+layout(constant_id = 0) const int MAX_MARCHES = 100;
+layout(constant_id = 1) const uint MAX_BOUNCES = 5; // at most MAX_BOUNCE_LEVELS
+layout(constant_id = 2) const float HIT_MARGIN = 0.001f;
+layout(constant_id = 3) const float NORMAL_EPS = 0.0001f; // small epsilon for normal calculations
+layout(constant_id = 4) const float MAX_DIST = 10000.f;
+layout(constant_id = 5) const bool DEBUG_BACKGROUND = true; // checkerboard instead of BG_COLOR
+
+const uint MAX_BOUNCE_LEVELS = 5; // size of buffers shared with the engine, which MAX_BOUNCES can't change
+
+// coarser bounce rays when they are traced at reduced resolution
+const int BOUNCE_MAX_MARCHES = MAX_MARCHES / 2;
+#define BOUNCE_HIT_MARGIN (HIT_MARGIN * 4.f)
 
 const float PI = 3.14159265358979323846264f;
 
-#ifdef DEBUG
-const float TILE_SIZE = 0.05f; // width/size of tiles
-#endif
+const float TILE_SIZE = 0.05f; // width/size of debug background tiles
 
 #endif
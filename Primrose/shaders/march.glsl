@@ -0,0 +1,376 @@
+#ifndef MARCH_GLSL
+#define MARCH_GLSL
+
+// shared sphere tracer, included after constants.glsl, structs.glsl, sdf.glsl and the `u` uniforms macro
+
+// operation storage, compute shaders redefine these to read from a shared memory cache
+#ifndef OPERATION
+#define OPERATION(i) u.operations[i]
+#define PRIMITIVE(i) u.primitives[i]
+#define TRANSFORMATION(i) u.transformations[i]
+#endif
+
+// ranges [x, y) of operations evaluated by map, compute shaders narrow these to the groups seen by a tile
+#ifndef NUM_RANGES
+#define NUM_RANGES 1
+#define RANGE(r) uvec2(0, min(u.numOperations, MAX_OPERATIONS))
+#endif
+
+// march precision, shaders tracing rays that get blurred lower these
+#ifndef MARCH_LIMIT
+#define MARCH_LIMIT MAX_MARCHES
+#define MARCH_MARGIN HIT_MARGIN
+#endif
+
+PointLight pointLights[] = {
+	PointLight(vec3(0, 10, 0), vec3(1), 1)
+};
+const uint numPointLights = 1;
+Material materials[] = { // color, emission, rough, spec, metal, ior, transmission
+	Material(vec3(0.72, 0.45, 0.20), 0.05, 0.70, 0.08, 0.90, 1.70, 0.00), // copper
+	Material(vec3(0.96, 0.99, 1.00), 0.05, 0.01, 0.42, 0.10, 1.45, 0.95), // glass
+	Material(vec3(0.73, 0.95, 1.00), 0.05, 0.05, 2.15, 0.30, 2.40, 0.85), // diamond
+};
+
+vec4 rand; // dither noise for the current pixel, set from blueNoise before marching
+uint marchSteps = 0; // steps taken by every march of the current pixel, for tuning the relaxation
+
+// misc functions
+float length2(vec3 v) {
+	return dot(v, v); // returns x^2 + y^2 + z^2, ie length(v)^2
+}
+
+// dither noise of a pixel, the texture tiles across the screen and holds one frame of blue noise per channel
+vec4 blueNoise(sampler2D noise, ivec2 pixel, uint frame) {
+	ivec2 size = textureSize(noise, 0);
+
+	// every four frames the tiling moves along the r2 sequence, so repeats of the texture don't line up over time
+	ivec2 shift = ivec2(fract(vec2(0.7548776662f, 0.5698402910f) * float(frame / 4)) * vec2(size));
+	vec4 n = texelFetch(noise, (pixel + shift) % size, 0);
+
+	uint channel = frame % 4;
+	return channel == 0 ? n : channel == 1 ? n.yzwx : channel == 2 ? n.zwxy : n.wxyz;
+}
+
+// camera
+vec3 focalPoint() {
+	return u.camPos - u.focalLength*u.camDir;
+}
+
+vec3 screenPoint(vec2 screenXY) { // point on the image plane, screenXY in [-1, 1] with y up
+	const vec3 forward = u.camDir;
+	const vec3 right = normalize(cross(u.camUp, forward));
+	const vec3 up = cross(forward, right);
+
+	return u.camPos + (screenXY.x*right + screenXY.y*u.screenHeight*up) * u.invZoom;
+}
+
+Ray screenRay(vec2 screenXY) {
+	vec3 fragPos = screenPoint(screenXY);
+	return Ray(fragPos, normalize(fragPos - focalPoint()));
+}
+
+Ray prevScreenRay(vec2 screenXY) { // same as screenRay, through last frame's camera
+	const vec3 forward = u.prevCamDir;
+	const vec3 right = normalize(cross(u.prevCamUp, forward));
+	const vec3 up = cross(forward, right);
+
+	vec3 fragPos = u.prevCamPos + (screenXY.x*right + screenXY.y*u.screenHeight*up) * u.invZoom;
+	return Ray(fragPos, normalize(fragPos - (u.prevCamPos - u.focalLength*forward)));
+}
+
+// pixel coordinates with y down, matching the interpolated screenXY of the fragment path
+vec2 pixelToScreen(vec2 pixel, vec2 size) {
+	return vec2(pixel.x / size.x * 2 - 1, 1 - pixel.y / size.y * 2);
+}
+vec2 screenToPixel(vec2 screenXY, vec2 size) {
+	return vec2((screenXY.x + 1) * 0.5f * size.x, (1 - screenXY.y) * 0.5f * size.y);
+}
+
+// inverse of prevScreenRay, false if the point is behind last frame's camera
+bool prevScreenXY(vec3 p, out vec2 screenXY) {
+	const vec3 forward = u.prevCamDir;
+	const vec3 right = normalize(cross(u.prevCamUp, forward));
+	const vec3 up = cross(forward, right);
+
+	vec3 focalPos = u.prevCamPos - u.focalLength*forward;
+	float depth = dot(p - focalPos, forward);
+	if (depth <= 0) return false;
+
+	vec3 offset = focalPos + (p - focalPos) * (u.focalLength / depth) - u.prevCamPos; // on the image plane
+	screenXY = vec2(dot(offset, right), dot(offset, up) / u.screenHeight) / u.invZoom;
+	return true;
+}
+
+// march algorithms
+// two interpreters over the same operations: a distance-only one for stepping, and one resolving the
+// material of a single group, run once at the hit
+
+// folds the render groups among operations [range.x, range.y) into the nearest distance d
+// groups are self contained, each sets its own transforms and only refers to its own operations
+// baked subtrees are sampled from the brick cache when it is bound and baked is set, see compute/bricks.glsl
+void mapRange(vec3 p, uvec2 range, bool baked, inout float d, inout uint group) {
+	float dBuffer[MAX_OPERATIONS];
+
+	vec4 pos = vec4(p, 1.f);
+	float smallScale = 1.f;
+
+	for (uint i = range.x; i < range.y; ++i) {
+		Operation op = OPERATION(i);
+
+		if (op.type == OP_TRANSFORM) {
+			pos = TRANSFORMATION(op.i).invMatrix * vec4(p, 1.f);
+			smallScale = TRANSFORMATION(op.i).smallScale;
+		} else if (op.type == OP_IDENTITY) {
+			dBuffer[i] = primSDF(pos.xyz, PRIMITIVE(op.i)) * smallScale;
+		} else if (op.type == OP_UNION) {
+			dBuffer[i] = min(dBuffer[op.i], dBuffer[op.j]);
+		} else if (op.type == OP_INTERSECTION) {
+			dBuffer[i] = max(dBuffer[op.i], dBuffer[op.j]);
+		} else if (op.type == OP_DIFFERENCE) {
+			dBuffer[i] = max(dBuffer[op.i], -dBuffer[op.j]);
+		} else if (op.type == OP_RENDER) {
+			if (dBuffer[op.i] <= d) group = i;
+			d = min(d, dBuffer[op.i]);
+		}
+#ifdef BRICK_CACHE
+		else if (op.type == OP_BRICK && baked) {
+			if (brickDistance(p, op.i, dBuffer[op.j])) i = op.j; // skip the subtree's own operations
+		}
+#endif
+	}
+}
+
+uint groupMaterial(vec3 p, uint group) { // material of a render group's surface nearest to p
+	float dBuffer[MAX_OPERATIONS];
+	uint matBuffer[MAX_OPERATIONS];
+
+	vec4 pos = vec4(p, 1.f);
+	float smallScale = 1.f;
+
+	for (uint i = OPERATION(group).j; i < group; ++i) {
+		Operation op = OPERATION(i);
+
+		if (op.type == OP_TRANSFORM) {
+			pos = TRANSFORMATION(op.i).invMatrix * vec4(p, 1.f);
+			smallScale = TRANSFORMATION(op.i).smallScale;
+
+		} else if (op.type == OP_IDENTITY) {
+			Primitive prim = PRIMITIVE(op.i);
+			matBuffer[i] = op.j;
+			dBuffer[i] = primSDF(pos.xyz, prim) * smallScale;
+
+		} else if (op.type == OP_UNION) {
+			float d1 = dBuffer[op.i];
+			float d2 = dBuffer[op.j];
+			matBuffer[i] = d1 < d2 ? matBuffer[op.i] : matBuffer[op.j];
+			dBuffer[i] = min(d1, d2);
+
+		} else if (op.type == OP_INTERSECTION) {
+			float d1 = dBuffer[op.i];
+			float d2 = dBuffer[op.j];
+			matBuffer[i] = d1 > d2 ? matBuffer[op.i] : matBuffer[op.j];
+			dBuffer[i] = max(d1, d2);
+
+		} else if (op.type == OP_DIFFERENCE) {
+			float d1 = dBuffer[op.i];
+			float d2 = dBuffer[op.j];
+			matBuffer[i] = d1 > -d2 ? matBuffer[op.i] : matBuffer[op.j];
+			dBuffer[i] = max(d1, -d2);
+		}
+	}
+
+	return matBuffer[OPERATION(group).i];
+}
+
+float mapNearest(vec3 p, out uint group) { // scene sdf, group is the OP_RENDER of the nearest surface
+	float d = MAX_DIST;
+	group = NO_GROUP;
+
+	for (uint r = 0; r < NUM_RANGES; ++r) {
+		mapRange(p, RANGE(r), true, d, group);
+	}
+
+	return d;
+}
+float map(vec3 p) {
+	uint _;
+	return mapNearest(p, _);
+}
+
+float mapGroup(vec3 p, uint group) { // exact sdf of a single render group, cost independent of the scene size
+	float d = MAX_DIST;
+	uint _;
+	mapRange(p, uvec2(OPERATION(group).j, group + 1), false, d, _);
+	return d;
+}
+
+vec3 mapNormal(Hit hit) { // tetrahedral taps, only evaluating the group that was hit
+	const vec2 k = vec2(1.f, -1.f);
+	return normalize(
+		k.xyy * mapGroup(hit.pos + k.xyy * NORMAL_EPS, hit.group) +
+		k.yyx * mapGroup(hit.pos + k.yyx * NORMAL_EPS, hit.group) +
+		k.yxy * mapGroup(hit.pos + k.yxy * NORMAL_EPS, hit.group) +
+		k.xxx * mapGroup(hit.pos + k.xxx * NORMAL_EPS, hit.group)
+	);
+}
+
+Hit march(Ray ray, float t) { // starting t along the ray, known to be clear of surfaces
+	float d;
+	vec3 pos = ray.pos + ray.dir * t;
+	uint group = NO_GROUP;
+	bool missed = false;
+
+	// over-relaxed sphere tracing, steps are stretched by omega while consecutive spheres overlap
+	float omega = u.relaxation;
+	float stepLength = 0.f;
+	float prevD = 0.f;
+
+	for (int m = 0; m < MARCH_LIMIT; ++m) {
+		noiseFootprint = noisePixelSpread * (t + u.focalLength);
+#ifdef CLIPMAP
+		// far from every surface a clipmap lookup bounds the step, the operations only run near surfaces
+		d = clipmapDistance(pos);
+		if (d < 0.f) d = abs(mapNearest(pos, group));
+#else
+		d = abs(mapNearest(pos, group));
+#endif
+		marchSteps += 1;
+
+		if (omega > 1.f && d + prevD < stepLength) {
+			// the gap between the spheres could hide a surface, step back inside the last one and stop relaxing
+			stepLength -= omega * stepLength;
+			omega = 1.f;
+		} else {
+			if (d <= MARCH_MARGIN && t >= MIN_DIST) break;
+			stepLength = d * omega;
+		}
+		if (t >= MAX_DIST) {
+			missed = true;
+			break;
+		}
+		prevD = d;
+
+		t += stepLength;
+		pos += ray.dir * stepLength;
+	}
+
+	// materials are only resolved once, for the surface that was hit
+	uint mat = missed || group == NO_GROUP ? NO_MAT : groupMaterial(pos, group);
+	return Hit(pos, t, d, mat, group);
+}
+Hit march(Ray ray) {
+	return march(ray, 0.f);
+}
+
+Hit dither(Hit hit, Ray ray) {
+	float b = rand.r * MARCH_MARGIN + hit.d; // b in range (d - MARCH_MARGIN, d)
+	hit.pos += ray.dir * b;
+	hit.t += b;
+	hit.d = mapGroup(hit.pos, hit.group);
+	return hit;
+}
+
+// material rendering
+#ifndef BOUNCE_QUEUE // wavefront shaders define their own pushBounce, see compute/bounce.glsl
+Bounce bounces[MAX_BOUNCES+1];
+uint numBounces = 0;
+
+void pushBounce(Bounce bounce) {
+	if (numBounces < MAX_BOUNCES) bounces[numBounces++] = bounce;
+}
+#endif
+
+// lit colour of a surface, blended in with the bounce's strength by the caller, secondary rays go to pushBounce
+vec3 renderMaterial(Hit hit, vec3 normal, Bounce bounce) { // normal facing out of the surface
+	Material m = materials[hit.mat];
+
+	vec3 newColor = vec3(0);
+
+	// reverse normal if inside material
+	if (bounce.insideMat != NO_MAT) normal = -normal;
+
+	vec3 reflDir = reflect(bounce.ray.dir, normal);
+
+	for (int i = 0; i < numPointLights; ++i) {
+		PointLight light = pointLights[i];
+
+		vec3 lightDir = normalize(light.pos - hit.pos);
+
+		float diff = max(dot(normal, lightDir), 0.0);
+		float spec = max(dot(reflDir, lightDir), 0.0);
+
+		newColor += m.baseColor * (diff*m.roughness + spec*m.specular + m.emission) * light.intensity;
+	}
+
+	float refl = m.metallic;
+	if (m.transmission > 0) {
+		float lastIor = bounce.insideMat == NO_MAT ? 1.0 : materials[bounce.insideMat].ior;
+		float nextIor = bounce.insideMat == NO_MAT ? m.ior : 1.0;
+		float ior = lastIor / nextIor;
+
+		vec3 refrDir = refract(bounce.ray.dir, normal, ior);
+
+		if (length(refrDir) != 0) {
+			pushBounce(Bounce(Ray(hit.pos + refrDir*MARCH_MARGIN, refrDir),
+				bounce.insideMat == NO_MAT ? hit.mat : NO_MAT, bounce.strength * m.transmission));
+		} else {
+			// internal reflection
+			refl += m.transmission;
+		}
+	}
+
+	if (refl > 0) {
+		pushBounce(Bounce(Ray(hit.pos + reflDir*MARCH_MARGIN, reflDir), bounce.insideMat, bounce.strength * m.metallic));
+	}
+
+	return newColor;
+}
+
+vec3 background(vec2 screenXY) {
+	if (DEBUG_BACKGROUND) {
+		bool tileType = (mod(screenXY.x, TILE_SIZE) < TILE_SIZE/2.f) ^^ (mod(screenXY.y, TILE_SIZE) < TILE_SIZE/2.f);
+		return tileType ? vec3(0.f, 0.01f, 0.f) : vec3(0.01f, 0.f, 0.01f);
+	}
+	return BG_COLOR;
+}
+
+#ifndef BOUNCE_QUEUE
+// colour of the scene along a primary ray, given the primary hit, already dithered, and its normal
+vec3 shadePixel(vec2 screenXY, Ray ray, Hit hit, vec3 normal) {
+	vec3 color = background(screenXY);
+
+	Bounce bounce = Bounce(ray, NO_MAT, 1);
+	for (int i = 0; i < numBounces+1; ++i) {
+		if (i > 0) {
+			hit = march(bounce.ray);
+			if (hit.mat != NO_MAT) {
+				hit = dither(hit, bounce.ray);
+				normal = mapNormal(hit);
+			}
+		}
+
+		if (hit.mat != NO_MAT) color = mix(color, renderMaterial(hit, normal, bounce), bounce.strength);
+
+		bounce = bounces[i];
+	}
+
+	return color;
+}
+
+// colour of the scene seen through a point on the screen
+vec3 marchPixel(vec2 screenXY) {
+	Ray ray = screenRay(screenXY);
+	Hit hit = march(ray);
+
+	vec3 normal = vec3(0);
+	if (hit.mat != NO_MAT) {
+		hit = dither(hit, ray);
+		normal = mapNormal(hit);
+	}
+
+	return shadePixel(screenXY, ray, hit, normal);
+}
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef NOISE_GLSL
+#define NOISE_GLSL
+
+// tileable value noise baked into a mipmapped 3D texture by the engine, see createNoiseVolume
+// r is smooth noise for large features, g is detail sampled at NOISE_DETAIL times the frequency on top of it
+// replaces the trigonometry of procedural primitives with two fetches per step, included before sdf.glsl by every
+// backend so they all draw the same surfaces
+
+layout(binding = 20) uniform sampler3D noiseVolume;
+
+const float NOISE_DETAIL = 4.f; // log2 of it is added to the detail lod
+const float NOISE_DETAIL_WEIGHT = 0.25f;
+
+// largest change of each channel between neighbouring texels, the smoothstep between lattice points 16 and 4 texels
+// apart changes by at most 1.5 per lattice cell, plus 8 bit rounding, keep in sync with the engine
+const vec2 NOISE_TEXEL_SLOPE = vec2(1.5f / 16.f, 1.5f / 4.f) + 1.f / 255.f;
+
+float noisePixelSpread = 0.f; // world size of a pixel per unit from the focal point, 0 always samples full detail
+float noiseFootprint = 0.f; // world size of a pixel where the ray is, set by march()
+
+// noise in [0, 1] at p, frequency in texels of the smooth channel per unit
+float volumeNoise(vec3 p, float frequency) {
+	vec3 uv = p * frequency / float(textureSize(noiseVolume, 0).x);
+
+	// the mips filter out detail smaller than a pixel, far surfaces are marched through the blurred noise
+	float lod = log2(max(noiseFootprint * frequency, 1.f));
+	float coarse = textureLod(noiseVolume, uv, lod).r;
+	float detail = textureLod(noiseVolume, uv * NOISE_DETAIL, lod + log2(NOISE_DETAIL)).g;
+	return mix(coarse, detail, NOISE_DETAIL_WEIGHT);
+}
+
+// largest slope of volumeNoise per unit, its mips are averages so they are never steeper
+float volumeNoiseSlope(float frequency) {
+	return frequency * sqrt(3.f) * mix(NOISE_TEXEL_SLOPE.x, NOISE_TEXEL_SLOPE.y * NOISE_DETAIL, NOISE_DETAIL_WEIGHT);
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define SDF_GLSL
 
 #include "constants.glsl"
+#include "noise.glsl"
 
 // misc functions
 float smin(float d1, float d2, float k) {
@@ -101,6 +102,19 @@ float prim4SDF(vec3 p) {
     return torusSDF(q, 1, 0.3f);
 }
 
+// procedural surfaces displaced by the noise volume, distances are divided by their lipschitz bound to stay safe
+float noiseRockSDF(vec3 p, float height, float frequency) { // unit sphere pushed out by up to height
+    float shell = length(p) - 1.f - height; // sphere holding every bump, a bound that needs no samples
+    if (shell > height) return shell;
+    return (length(p) - 1.f - height * volumeNoise(p, frequency)) / (1.f + height * volumeNoiseSlope(frequency));
+}
+
+float noiseTerrainSDF(vec3 p, float height, float frequency) { // ground at y = 0 raised by up to height
+    float ceiling = p.y - height;
+    if (ceiling > height) return ceiling;
+    return (p.y - height * volumeNoise(p, frequency)) / (1.f + height * volumeNoiseSlope(frequency));
+}
+
 float primSDF(vec3 p, Primitive prim) {
     switch (prim.type) {
         case PRIM_SPHERE: return sphereSDF(p);
@@ -112,6 +126,8 @@ float primSDF(vec3 p, Primitive prim) {
         case PRIM_P2: return prim2SDF(p, prim.a);
         case PRIM_P3: return prim3SDF(p);
         case PRIM_P4: return prim4SDF(p);
+        case PRIM_P5: return noiseRockSDF(p, prim.a, prim.b);
+        case PRIM_P6: return noiseTerrainSDF(p, prim.a, prim.b);
     }
 }
 
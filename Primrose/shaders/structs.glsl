@@ -6,6 +6,7 @@ struct Operation {
 	uint type; // OP_ prefix
 	uint i; // index of first operand
 	uint j; // index of second operand
+	uint flags; // OP_FLAG prefix
 };
 
 struct Primitive {
@@ -39,11 +40,17 @@ struct PointLight {
 	float intensity;
 };
 
+struct Bounds {
+	vec3 min;
+	vec3 max;
+};
+
 struct ModelAttributes {
 	mat4 invMatrix;
 	float invScale;
 	vec3 aabbMin;
 	vec3 aabbMax;
+	uint part; // which part of its blas' sdf the aabb bounds
 };
 
 struct MarchUniforms {
@@ -55,9 +62,7 @@ struct MarchUniforms {
 
 	float focalLength;
 	float invZoom;
-
-	ModelAttributes attributes[100];
-	uint geometryAttributeOffset[100];
+	float relaxation; // over-relaxation factor of sphere tracing steps, 1 for plain sphere tracing
 
 //	// pre-computed
 //	vec3 camPosRcp;
@@ -66,6 +71,19 @@ struct MarchUniforms {
 	Operation operations[100];
 	Primitive primitives[100];
 	Transformation transformations[100];
+	Bounds renderBounds[100]; // world space bounds of each OP_RENDER group, indexed by operation
+
+	// camera of the last frame, for reprojection
+	vec3 prevCamPos;
+	vec3 prevCamDir;
+	vec3 prevCamUp;
+
+	// distance clipmap around the camera, see clipmap.glsl
+	// first texel of each level in the level's texels, sized by a literal MAX_CLIPMAP_LEVELS since this file is
+	// included without constants.glsl, shader_structs.hpp asserts they match
+	ivec3 clipmapOrigins[8];
+	float clipmapTexel; // texel size of the finest level
+	uint clipmapLevels; // 0 when there is no clipmap
 };
 
 // march structs
@@ -79,6 +97,13 @@ struct Hit {
 	float t; // ray t-value
 	float d; // distance from surface
 	uint mat; // material index
+	uint group; // OP_RENDER operation of the surface that was hit
+};
+
+struct Bounce {
+	Ray ray;
+	uint insideMat;
+	float strength;
 };
 
 #endif
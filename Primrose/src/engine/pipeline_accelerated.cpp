@@ -3,27 +3,39 @@
 #include "engine/setup.hpp"
 #include "log.hpp"
 #include "embed/main_rgen_spv.h"
-#include "embed/main_rint_spv.h"
 #include "embed/main_rahit_spv.h"
 #include "embed/main_rchit_spv.h"
 #include "embed/main_rmiss_spv.h"
+#include "embed/node_rint.h"
+#include "embed/constants_glsl.h"
+#include "embed/structs_glsl.h"
+#include "embed/sdf_glsl.h"
+#include "embed/noise_glsl.h"
 #include "scene/scene.hpp"
 #include "state.hpp"
 
 #include <vulkan/vulkan.hpp>
 #include <stdexcept>
 #include <iostream>
+#include <map>
+#include <algorithm>
 #include <shaderc/shaderc.hpp>
 
 namespace {
 	using namespace Primrose;
 
+	QualitySettings pipelineQuality; // quality mainPipeline was specialized with
+
 	static void createAcceleratedPipeline(std::vector<vk::ShaderModule> intersectionShaders) {
 		log("Creating accelerated pipeline");
 
+		pipelineQuality = quality;
+		vk::SpecializationInfo specialization = pipelineQuality.specializationInfo();
+
 		// shader stages info
 		vk::PipelineShaderStageCreateInfo rgenInfo({}, vk::ShaderStageFlagBits::eRaygenKHR,
-			createShaderModule(reinterpret_cast<uint32_t*>(mainRgenSpvData), mainRgenSpvSize), "main");
+			createShaderModule(reinterpret_cast<uint32_t*>(mainRgenSpvData), mainRgenSpvSize), "main",
+			&specialization);
 		vk::PipelineShaderStageCreateInfo rmissInfo({}, vk::ShaderStageFlagBits::eMissKHR,
 			createShaderModule(reinterpret_cast<uint32_t*>(mainRmissSpvData), mainRmissSpvSize), "main");
 
@@ -36,7 +48,7 @@ namespace {
 		int nonIntersectionShaders = stages.size();
 		for (const auto& shader : intersectionShaders) {
 			stages.push_back(vk::PipelineShaderStageCreateInfo({},
-				vk::ShaderStageFlagBits::eIntersectionKHR, shader, "main"));
+				vk::ShaderStageFlagBits::eIntersectionKHR, shader, "main", &specialization));
 		}
 
 		// shader groups info
@@ -64,7 +76,7 @@ namespace {
 			rtProperties.maxRayRecursionDepth, // use device max recursion for max ray recursions
 			nullptr, nullptr, nullptr, mainPipelineLayout);
 
-		auto res = device.createRayTracingPipelineKHR(VK_NULL_HANDLE, VK_NULL_HANDLE, pipelineInfo);
+		auto res = device.createRayTracingPipelineKHR(VK_NULL_HANDLE, pipelineCache, pipelineInfo);
 		if (res.result != vk::Result::eSuccess) throw std::runtime_error("failed to create accelerated pipeline");
 		mainPipeline = res.value;
 
@@ -94,25 +106,14 @@ namespace {
 
 		// get handles to shader groups
 		std::vector<uint8_t> handles = device.getRayTracingShaderGroupHandlesKHR<uint8_t>(mainPipeline,
-			0, numGroups, tableSize);
+			0, numGroups, numGroups * handleSize);
 
-		// copy handles to the shader table memory
+		// copy handles to the shader table memory, one group per aligned record:
+		// raygen, miss, then the hit group of each geometry in order
 		uint8_t* dst = reinterpret_cast<uint8_t*>(device.mapMemory(rayShaderTableMemory, 0, tableSize));
-
-		memcpy(dst, handles.data(), handleSize); // copy raygen group
-		memcpy(dst + prog, handles.data() + handleSize, handleSize); // copy miss group
-		for (int i = 0; i < numGroups - 4; ++i) { // each intersection shader
-			memcpy(dst + (2 + 3*i)*prog, handles.data() + 2*handleSize, 2*handleSize); // copy ahit/chit handles
-			memcpy(dst + (4 + 3*i)*prog, handles.data() + (4 + i)*handleSize, handleSize); // copy int handle
+		for (int i = 0; i < numGroups; ++i) {
+			memcpy(dst + i*prog, handles.data() + i*handleSize, handleSize);
 		}
-//		memcpy(dst + 2*prog, handles.data() + 2*handleSize, tableSize - 2*handleSize); // copy hit groups
-
-//		for (int i = 0; i < numGroups; ++i) {
-//			uint8_t* src = handles.data() + (i * rtProperties.shaderGroupHandleSize);
-//			memcpy(dst, src, rtProperties.shaderGroupHandleSize); // copy hit group handle
-//
-//			dst += handleSize;
-//		}
 		device.unmapMemory(rayShaderTableMemory);
 
 		// get device addresses for shader groups
@@ -128,117 +129,185 @@ namespace {
 		callableGroupAddress = vk::StridedDeviceAddressRegionKHR();
 	}
 
-	static void createBottomAccelerationStructure(std::vector<vk::AabbPositionsKHR> aabbData,
-		std::vector<ModelAttributes> aabbAttributes, vk::AccelerationStructureKHR* blas,
-		vk::Buffer* blasBuffer, vk::DeviceMemory* blasMemory) {
+	static vk::DeviceAddress reserveScratch(vk::DeviceSize size) { // grows the shared scratch buffer if needed
+		if (size > structureScratchCapacity) {
+			device.destroyBuffer(structureScratchBuffer);
+			device.freeMemory(structureScratchMemory);
+
+			structureScratchCapacity = size;
+			structureMemory.scratch = size;
+			createBuffer(structureScratchCapacity,
+				vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+				vk::MemoryPropertyFlagBits::eDeviceLocal, &structureScratchBuffer, &structureScratchMemory, true);
+		}
+
+		return device.getBufferAddress(vk::BufferDeviceAddressInfo(structureScratchBuffer));
+	}
+
+	static void createBottomAccelerationStructure(std::vector<vk::AabbPositionsKHR> aabbData, BottomStructure* blas) {
 
 		log("Creating bottom-level acceleration structure");
 
 		// store aabb data in device buffer
 		vk::Buffer aabbDataBuffer;
 		vk::DeviceMemory aabbDataMemory;
-		createBuffer(aabbData.size() * sizeof(vk::AabbPositionsKHR), vk::BufferUsageFlagBits::eShaderDeviceAddress
+		createBuffer(std::max<size_t>(aabbData.size(), 1) * sizeof(vk::AabbPositionsKHR), vk::BufferUsageFlagBits::eShaderDeviceAddress
 																	 | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
 			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
 			&aabbDataBuffer, &aabbDataMemory, true);
-		writeToDevice(aabbDataMemory, aabbData.data(), aabbData.size() * sizeof(vk::AabbPositionsKHR));
+		if (!aabbData.empty()) {
+			writeToDevice(aabbDataMemory, aabbData.data(), aabbData.size() * sizeof(vk::AabbPositionsKHR));
+		}
 
 		vk::DeviceAddress aabbDataBufferAddress = device.getBufferAddress(vk::BufferDeviceAddressInfo(aabbDataBuffer));
 
-		std::vector<vk::AccelerationStructureBuildRangeInfoKHR> buildRanges;
-		std::vector<uint32_t> primitiveCounts;
-
-		// geometry per aabb
-		std::vector<vk::AccelerationStructureGeometryKHR> geometries;
-		unsigned int attributeOffset = 0;
-		for (int i = 0; i < aabbData.size(); ++i) {
-			vk::AccelerationStructureGeometryKHR geom{};
-			geom.geometryType = vk::GeometryTypeKHR::eAabbs;
-			geom.flags = vk::GeometryFlagBitsKHR::eNoDuplicateAnyHitInvocation;
-			geom.geometry.aabbs = vk::AccelerationStructureGeometryAabbsDataKHR(
-				vk::DeviceOrHostAddressConstKHR(aabbDataBufferAddress), sizeof(vk::AabbPositionsKHR));
-
-			geometries.push_back(geom);
-
-			uniforms.geometryAttributeOffset[geometries.size()-1] = attributeOffset;
-			uniforms.attributes[attributeOffset] = aabbAttributes[i];
-			attributeOffset += 1;
+		// one geometry holding every aabb as a primitive, gl_PrimitiveID is the aabb's index
+		vk::AccelerationStructureGeometryKHR geom{};
+		geom.geometryType = vk::GeometryTypeKHR::eAabbs;
+		geom.flags = vk::GeometryFlagBitsKHR::eNoDuplicateAnyHitInvocation;
+		geom.geometry.aabbs = vk::AccelerationStructureGeometryAabbsDataKHR(
+			vk::DeviceOrHostAddressConstKHR(aabbDataBufferAddress), sizeof(vk::AabbPositionsKHR));
 
-			buildRanges.push_back(vk::AccelerationStructureBuildRangeInfoKHR(1, sizeof(vk::AabbPositionsKHR)*i, 0, 0));
-			primitiveCounts.push_back(1);
-		}
+		uint32_t primitiveCount = aabbData.size();
+		vk::AccelerationStructureBuildRangeInfoKHR buildRange(primitiveCount, 0, 0, 0);
 
 		vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{};
 		buildInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
 		buildInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+		if (Settings::compactStructures) buildInfo.flags |= vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction;
 		buildInfo.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
-		buildInfo.geometryCount = geometries.size();
-		buildInfo.pGeometries = geometries.data();
+		buildInfo.geometryCount = 1;
+		buildInfo.pGeometries = &geom;
 
 		vk::AccelerationStructureBuildSizesInfoKHR buildSizes = device.getAccelerationStructureBuildSizesKHR(
-			vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, primitiveCounts);
+			vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, primitiveCount);
 
 		createBuffer(buildSizes.accelerationStructureSize, vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR,
-			vk::MemoryPropertyFlagBits::eDeviceLocal, blasBuffer, blasMemory);
+			vk::MemoryPropertyFlagBits::eDeviceLocal, &blas->buffer, &blas->memory);
 
 		vk::AccelerationStructureCreateInfoKHR asInfo{};
-		asInfo.buffer = *blasBuffer;
+		asInfo.buffer = blas->buffer;
 		asInfo.offset = 0;
 		asInfo.size = buildSizes.accelerationStructureSize;
 		asInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
 
-		*blas = device.createAccelerationStructureKHR(asInfo);
+		blas->structure = device.createAccelerationStructureKHR(asInfo);
 
-		vk::Buffer scratchBuffer;
-		vk::DeviceMemory scratchMemory;
-		createBuffer(buildSizes.buildScratchSize,
-			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-			vk::MemoryPropertyFlagBits::eDeviceLocal, &scratchBuffer, &scratchMemory, true);
-		vk::DeviceAddress scratchAddress = device.getBufferAddress(vk::BufferDeviceAddressInfo(scratchBuffer));
+		buildInfo.dstAccelerationStructure = blas->structure;
+		buildInfo.scratchData.deviceAddress = reserveScratch(buildSizes.buildScratchSize);
 
-		buildInfo.dstAccelerationStructure = *blas;
-		buildInfo.scratchData.deviceAddress = scratchAddress;
+		vk::QueryPool sizeQuery;
+		if (Settings::compactStructures) {
+			sizeQuery = device.createQueryPool(vk::QueryPoolCreateInfo({},
+				vk::QueryType::eAccelerationStructureCompactedSizeKHR, 1));
+		}
 
 		// build acceleration structure
 		vk::CommandBuffer cmd = startSingleTimeCommandBuffer();
-		cmd.buildAccelerationStructuresKHR({buildInfo}, {buildRanges.data()});
+		cmd.buildAccelerationStructuresKHR({buildInfo}, {&buildRange});
+		if (Settings::compactStructures) { // query the size it compacts to once the build finishes
+			vk::MemoryBarrier barrier(vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+				vk::AccessFlagBits::eAccelerationStructureReadKHR);
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+				vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, barrier, {}, {});
+
+			cmd.resetQueryPool(sizeQuery, 0, 1);
+			cmd.writeAccelerationStructuresPropertiesKHR(blas->structure,
+				vk::QueryType::eAccelerationStructureCompactedSizeKHR, sizeQuery, 0);
+		}
 		endSingleTimeCommandBuffer(cmd);
 
-		// cleanup
-		device.freeMemory(scratchMemory);
-		device.destroyBuffer(scratchBuffer);
+		structureMemory.bottomUncompacted += buildSizes.accelerationStructureSize;
+		vk::DeviceSize size = buildSizes.accelerationStructureSize;
+
+		if (Settings::compactStructures) {
+			vk::DeviceSize compactedSize = device.getQueryPoolResult<vk::DeviceSize>(sizeQuery, 0, 1,
+				sizeof(vk::DeviceSize), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait).value;
+			device.destroyQueryPool(sizeQuery);
+
+			// copy into a right-sized structure and free the original
+			BottomStructure compacted;
+			createBuffer(compactedSize, vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR,
+				vk::MemoryPropertyFlagBits::eDeviceLocal, &compacted.buffer, &compacted.memory);
+			asInfo.buffer = compacted.buffer;
+			asInfo.size = compactedSize;
+			compacted.structure = device.createAccelerationStructureKHR(asInfo);
+
+			cmd = startSingleTimeCommandBuffer();
+			cmd.copyAccelerationStructureKHR(vk::CopyAccelerationStructureInfoKHR(blas->structure, compacted.structure,
+				vk::CopyAccelerationStructureModeKHR::eCompact));
+			endSingleTimeCommandBuffer(cmd);
+
+			device.destroyAccelerationStructureKHR(blas->structure);
+			device.destroyBuffer(blas->buffer);
+			device.freeMemory(blas->memory);
+			*blas = compacted;
+			size = compactedSize;
+		}
+		structureMemory.bottom += size;
 
+		// cleanup
 		device.freeMemory(aabbDataMemory);
 		device.destroyBuffer(aabbDataBuffer);
 	};
 
-	static void createTopAccelerationStructure(vk::AccelerationStructureKHR blas,
-		vk::AccelerationStructureKHR* tlas, vk::Buffer* tlasBuffer, vk::DeviceMemory* tlasMemory) {
+	static vk::TransformMatrixKHR toTransformMatrix(glm::mat4 matrix) { // row major 3x4
+		vk::TransformMatrixKHR transform{};
+		for (int row = 0; row < 3; ++row) {
+			transform.matrix[row] = vk::ArrayWrapper1D<float, 4>({
+				matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]});
+		}
+		return transform;
+	}
 
-		log("Creating top-level acceleration structure");
+	std::vector<std::string> subtreeGlsl; // sdf of each blas in bottomStructures, in its own space
+	std::vector<uint> subtreeAttributes; // first attribute of each blas in attributeBuffer
+	std::vector<uint> instanceSubtrees; // blas of each instance in topStructure
+
+	static void writeInstances(const std::vector<Node*>& nodes, const std::vector<uint>& subtrees) {
+		std::vector<vk::AccelerationStructureInstanceKHR> instanceData;
+		for (int i = 0; i < nodes.size(); ++i) {
+			// place the subtree's blas with the node's transform
+			vk::DeviceAddress blasAddress = device.getAccelerationStructureAddressKHR(
+				vk::AccelerationStructureDeviceAddressInfoKHR(bottomStructures[subtrees[i]].structure));
+			instanceData.push_back(vk::AccelerationStructureInstanceKHR(toTransformMatrix(nodes[i]->modelMatrix()),
+				subtreeAttributes[subtrees[i]], 0xFF, subtrees[i], {}, blasAddress));
+		}
 
-		// instance data
-		vk::DeviceAddress blStructureAddress = device.getAccelerationStructureAddressKHR(
-			vk::AccelerationStructureDeviceAddressInfoKHR(blas));
+		// grow the persistent instance buffer if needed
+		if (instanceData.size() > instanceCapacity) {
+			device.destroyBuffer(instanceBuffer);
+			device.freeMemory(instanceMemory);
+
+			instanceCapacity = instanceData.size();
+			structureMemory.instances = instanceCapacity * sizeof(vk::AccelerationStructureInstanceKHR);
+			createBuffer(instanceCapacity * sizeof(vk::AccelerationStructureInstanceKHR),
+				vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR
+				| vk::BufferUsageFlagBits::eShaderDeviceAddress,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+				&instanceBuffer, &instanceMemory, true);
+		}
 
-		vk::TransformMatrixKHR identityMatrix{};
-		identityMatrix.matrix[0] = vk::ArrayWrapper1D<float, 4>({1, 0, 0, 0});
-		identityMatrix.matrix[1] = vk::ArrayWrapper1D<float, 4>({0, 1, 0, 0});
-		identityMatrix.matrix[2] = vk::ArrayWrapper1D<float, 4>({0, 0, 1, 0});
+		if (!instanceData.empty()) {
+			writeToDevice(instanceMemory,
+				instanceData.data(), instanceData.size() * sizeof(vk::AccelerationStructureInstanceKHR));
+		}
+	}
 
-		std::vector<vk::AccelerationStructureInstanceKHR> instanceData = {
-			vk::AccelerationStructureInstanceKHR(identityMatrix, 0, 0xFF, 0, {}, blStructureAddress)
-		};
+	// builds topStructure over the first numInstances of the instance buffer, or refits it in place if update
+	enum class TopBuild {
+		CREATE, // allocates topStructure and builds it
+		REBUILD, // builds the existing topStructure from scratch, for the same number of instances
+		REFIT, // updates the existing topStructure in place, cheaper but the bvh gets worse with each refit
+	};
+	uint topRefits = 0; // refits since topStructure was last built from scratch
 
-		vk::Buffer instanceBuffer;
-		vk::DeviceMemory instanceMemory;
-		createBuffer(instanceData.size() * sizeof(vk::AccelerationStructureInstanceKHR),
-			vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR
-			| vk::BufferUsageFlagBits::eShaderDeviceAddress,
-			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-			&instanceBuffer, &instanceMemory, true);
-		writeToDevice(instanceMemory,
-			instanceData.data(), instanceData.size() * sizeof(vk::AccelerationStructureInstanceKHR));
+	static void buildTopAccelerationStructure(uint numInstances, TopBuild mode) {
+		log(mode == TopBuild::REFIT ? "Refitting top-level acceleration structure"
+			: mode == TopBuild::REBUILD ? "Rebuilding top-level acceleration structure"
+			: "Creating top-level acceleration structure");
+		topRefits = mode == TopBuild::REFIT ? topRefits + 1 : 0;
+		bool update = mode == TopBuild::REFIT;
 
 		vk::AccelerationStructureGeometryKHR geom{};
 		geom.geometryType = vk::GeometryTypeKHR::eInstances;
@@ -249,53 +318,123 @@ namespace {
 		// fill build info struct enough to calculate structure size
 		vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{};
 		buildInfo.type = vk::AccelerationStructureTypeKHR::eTopLevel;
-		buildInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
-		buildInfo.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
+		buildInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace
+			| vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
+		buildInfo.mode = update ? vk::BuildAccelerationStructureModeKHR::eUpdate
+			: vk::BuildAccelerationStructureModeKHR::eBuild;
 		buildInfo.geometryCount = 1;
 		buildInfo.pGeometries = &geom;
 
 		// calculate structure build size
 		vk::AccelerationStructureBuildSizesInfoKHR buildSizes = device.getAccelerationStructureBuildSizesKHR(
-			vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, {static_cast<unsigned int>(instanceData.size())});
-
-		// create buffer for structure
-		createBuffer(buildSizes.accelerationStructureSize, vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR,
-			vk::MemoryPropertyFlagBits::eDeviceLocal, tlasBuffer, tlasMemory);
-
-		// create structure
-		vk::AccelerationStructureCreateInfoKHR asInfo{};
-		asInfo.buffer = *tlasBuffer;
-		asInfo.offset = 0;
-		asInfo.size = buildSizes.accelerationStructureSize;
-		asInfo.type = vk::AccelerationStructureTypeKHR::eTopLevel;
-		*tlas = device.createAccelerationStructureKHR(asInfo);
-
-		// create scratch buffer
-		vk::Buffer scratchBuffer;
-		vk::DeviceMemory scratchMemory;
-		createBuffer(buildSizes.buildScratchSize,
-			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-			vk::MemoryPropertyFlagBits::eDeviceLocal, &scratchBuffer, &scratchMemory, true);
-		vk::DeviceAddress scratchAddress = device.getBufferAddress(vk::BufferDeviceAddressInfo(scratchBuffer));
+			vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, {numInstances});
+
+		if (update) {
+			buildInfo.srcAccelerationStructure = topStructure;
+		} else if (mode == TopBuild::CREATE) {
+			// create buffer for structure
+			createBuffer(buildSizes.accelerationStructureSize,
+				vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR,
+				vk::MemoryPropertyFlagBits::eDeviceLocal, &topStructureBuffer, &topStructureMemory);
+
+			// create structure
+			vk::AccelerationStructureCreateInfoKHR asInfo{};
+			asInfo.buffer = topStructureBuffer;
+			asInfo.offset = 0;
+			asInfo.size = buildSizes.accelerationStructureSize;
+			asInfo.type = vk::AccelerationStructureTypeKHR::eTopLevel;
+			topStructure = device.createAccelerationStructureKHR(asInfo);
+			structureMemory.top = buildSizes.accelerationStructureSize;
+		}
 
 		// finish build info structure
-		buildInfo.dstAccelerationStructure = *tlas;
-		buildInfo.scratchData.deviceAddress = scratchAddress;
+		buildInfo.dstAccelerationStructure = topStructure;
+		buildInfo.scratchData.deviceAddress = reserveScratch(
+			update ? buildSizes.updateScratchSize : buildSizes.buildScratchSize);
 
 		// build acceleration structure
-		vk::AccelerationStructureBuildRangeInfoKHR buildRange(instanceData.size(), 0, 0, 0);
+		vk::AccelerationStructureBuildRangeInfoKHR buildRange(numInstances, 0, 0, 0);
 
 		vk::CommandBuffer cmd = startSingleTimeCommandBuffer();
+		if (mode != TopBuild::CREATE) { // frames already submitted may still be tracing against the structure
+			vk::MemoryBarrier barrier(vk::AccessFlagBits::eAccelerationStructureReadKHR,
+				vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+				vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, barrier, {}, {});
+		}
 		cmd.buildAccelerationStructuresKHR({buildInfo}, {&buildRange});
 		endSingleTimeCommandBuffer(cmd);
+	};
 
-		// cleanup
-		device.freeMemory(scratchMemory);
-		device.destroyBuffer(scratchBuffer);
+	// splits terms[begin, end) into clusters, each bounded by its own aabb primitive, while the surface area
+	// heuristic says marching fewer terms through smaller boxes is worth the extra primitive
+	static void clusterTerms(std::vector<IntersectionTerm>& terms, size_t begin, size_t end,
+		std::vector<std::pair<size_t, size_t>>& clusters) {
+
+		AABB bounds;
+		for (size_t i = begin; i < end; ++i) bounds.unionWith(terms[i].aabb);
+
+		// cost of a cluster is its surface area, how likely a ray enters it, times the terms marched inside
+		size_t count = end - begin;
+		float bestCost = bounds.surfaceArea() * count;
+		float splitCost = bounds.surfaceArea() * Settings::aabbSplitCost;
+		int bestAxis = -1;
+		size_t bestSplit = 0;
+
+		auto sortAlong = [&](int axis) {
+			std::sort(terms.begin() + begin, terms.begin() + end, [axis](IntersectionTerm& a, IntersectionTerm& b) {
+				return a.aabb.getMin()[axis] + a.aabb.getMax()[axis] < b.aabb.getMin()[axis] + b.aabb.getMax()[axis];
+			});
+		};
 
-		device.freeMemory(instanceMemory);
-		device.destroyBuffer(instanceBuffer);
-	};
+		for (int axis = 0; axis < 3 && count > 1; ++axis) {
+			sortAlong(axis);
+
+			std::vector<float> rightArea(count);
+			AABB right;
+			for (size_t i = count - 1; i > 0; --i) {
+				right.unionWith(terms[begin + i].aabb);
+				rightArea[i] = right.surfaceArea();
+			}
+
+			AABB left;
+			for (size_t i = 1; i < count; ++i) { // split before term i
+				left.unionWith(terms[begin + i - 1].aabb);
+				float cost = splitCost + left.surfaceArea() * i + rightArea[i] * (count - i);
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = begin + i;
+				}
+			}
+		}
+
+		if (bestAxis == -1) {
+			clusters.push_back({begin, end});
+			return;
+		}
+
+		sortAlong(bestAxis);
+		clusterTerms(terms, begin, bestSplit, clusters);
+		clusterTerms(terms, bestSplit, end, clusters);
+	}
+
+	// root nodes to instance and the unique subtree each places, hidden nodes are skipped
+	static void findSubtrees(Scene& scene,
+		std::vector<std::string>& glsl, std::vector<Node*>& nodes, std::vector<uint>& subtrees) {
+
+		for (const auto& node : scene.root.getChildren()) {
+			// generated relative to the node, so every placement of the same subtree (eg. a ref) shares its blas
+			std::string nodeGlsl = node->generateIntersectionGlsl(node.get());
+			if (nodeGlsl.empty()) continue;
+
+			uint index = std::find(glsl.begin(), glsl.end(), nodeGlsl) - glsl.begin();
+			if (index == glsl.size()) glsl.push_back(nodeGlsl);
+
+			nodes.push_back(node.get());
+			subtrees.push_back(index);
+		}
+	}
 }
 
 void Primrose::createAcceleratedPipelineLayout() {
@@ -305,7 +444,7 @@ void Primrose::createAcceleratedPipelineLayout() {
 		vk::PushConstantRange(vk::ShaderStageFlagBits::eRaygenKHR, 0, 128) // 128 bytes is min supported push size
 	};
 
-	std::array<vk::DescriptorSetLayoutBinding, 4> bindings = {
+	std::array<vk::DescriptorSetLayoutBinding, 6> bindings = {
 		vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eAccelerationStructureKHR, 1,
 			vk::ShaderStageFlagBits::eRaygenKHR),
 		vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageImage, 1,
@@ -314,6 +453,10 @@ void Primrose::createAcceleratedPipelineLayout() {
 			vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eIntersectionKHR),
 		vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eCombinedImageSampler, 1,
 			{}),
+		vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer, 1,
+			vk::ShaderStageFlagBits::eIntersectionKHR),
+		vk::DescriptorSetLayoutBinding(20, vk::DescriptorType::eCombinedImageSampler, 1,
+			vk::ShaderStageFlagBits::eIntersectionKHR), // noise volume of procedural primitives
 	};
 	vk::DescriptorSetLayoutCreateInfo descLayoutInfo(
 		vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR, bindings);
@@ -324,33 +467,81 @@ void Primrose::createAcceleratedPipelineLayout() {
 }
 
 void Primrose::generateAcceleratedScene(Scene& scene) {
-	std::vector<vk::AabbPositionsKHR> aabbData;
-	std::vector<ModelAttributes> aabbAttributes;
-	std::vector<vk::ShaderModule> intersectionShaders;
+	std::vector<Node*> nodes;
+	subtreeGlsl.clear();
+	subtreeAttributes.clear();
+	instanceSubtrees.clear();
+	findSubtrees(scene, subtreeGlsl, nodes, instanceSubtrees);
+
+	// sources node.rint includes, the node's sdf is added as node_sdf.glsl
+	std::map<std::string, std::string> includes = {
+		{"constants.glsl", std::string(constantsGlslData, constantsGlslSize)},
+		{"structs.glsl", std::string(structsGlslData, structsGlslSize)},
+		{"sdf.glsl", std::string(sdfGlslData, sdfGlslSize)},
+		{"noise.glsl", std::string(noiseGlslData, noiseGlslSize)},
+	};
+	std::string intersectionCode(nodeRintData, nodeRintSize);
 
-	for (const auto& node : scene.root.getChildren()) {
-//		std::string sdfCode = fmt::format("float sdf(vec3 p) {{ return {}; }}", node->generateIntersectionGlsl());
+	std::vector<ModelAttributes> attributes;
+	std::vector<vk::ShaderModule> intersectionShaders;
+	for (uint i = 0; i < subtreeGlsl.size(); ++i) {
+		Node* node = nodes[std::find(instanceSubtrees.begin(), instanceSubtrees.end(), i) - instanceSubtrees.begin()];
+
+		// split the subtree's unions into terms, in its own space, and group them into separately bounded parts
+		std::vector<IntersectionTerm> terms;
+		node->generateIntersectionTerms(node, terms);
+		std::erase_if(terms, [](IntersectionTerm& term) { return term.aabb.isEmpty(); }); // can't be hit
+
+		std::vector<std::pair<size_t, size_t>> clusters;
+		if (!terms.empty()) clusterTerms(terms, 0, terms.size(), clusters);
+
+		// aabb attributes to be passed to shader, found from the instance's custom index and the primitive id
+		std::vector<vk::AabbPositionsKHR> aabbData;
+		std::string sdfCode = "";
+		subtreeAttributes.push_back(attributes.size());
+		for (uint part = 0; part < clusters.size(); ++part) {
+			AABB aabb;
+			std::string glsl = "";
+			for (size_t t = clusters[part].first; t < clusters[part].second; ++t) {
+				aabb.unionWith(terms[t].aabb);
+				glsl = glsl.empty() ? terms[t].glsl : fmt::format("opUnion({}, {})", glsl, terms[t].glsl);
+			}
+
+			aabbData.push_back(aabb.toVkStruct());
+			attributes.push_back(ModelAttributes(glm::mat4(1), 1.f, aabb.getMin(), aabb.getMax(), part));
+			sdfCode += fmt::format("float sdf{}(vec3 p) {{ return {}; }}\n", part, glsl);
+		}
 
-		// generate aabb
-		AABB aabb = node->generateAabb();
-		aabbData.push_back(aabb.toVkStruct());
+		// each aabb marches only its own part
+		sdfCode += "float sdf(vec3 p) {\n";
+		if (!clusters.empty()) {
+			sdfCode += "\tswitch (attr.part) {\n";
+			for (uint part = 0; part < clusters.size(); ++part) {
+				sdfCode += fmt::format("\t\tcase {0}: return sdf{0}(p);\n", part);
+			}
+			sdfCode += "\t}\n";
+		}
+		sdfCode += "\treturn MAX_DIST;\n}\n";
 
-		// aabb attributes to be passed to shader
-		glm::mat4 modelMatrix = node->modelMatrix();
-		aabbAttributes.push_back(ModelAttributes(
-			glm::inverse(modelMatrix), 1.f / getSmallScale(modelMatrix),
-			aabb.getMin(), aabb.getMax()));
+		bottomStructures.emplace_back();
+		createBottomAccelerationStructure(aabbData, &bottomStructures.back());
 
-		// add intersection shader
-		intersectionShaders.push_back(
-			createShaderModule(reinterpret_cast<uint32_t*>(mainRintSpvData), mainRintSpvSize));
+		// add intersection shader, the hit group of blas i is the i'th after raygen and miss
+		includes["node_sdf.glsl"] = sdfCode;
+		intersectionShaders.push_back(compileShaderModule(intersectionCode,
+			vk::ShaderStageFlagBits::eIntersectionKHR, includes));
 
-		log(fmt::format("{}: min({}, {}, {}), max({}, {}, {})", node->name,
-			aabbData.back().minX, aabbData.back().minY, aabbData.back().minZ,
-			aabbData.back().maxX, aabbData.back().maxY, aabbData.back().maxZ));
+		log(fmt::format("{}: {} terms in {} aabbs", node->name, terms.size(), clusters.size()));
 	}
-	intersectionShaders.push_back(
-		createShaderModule(reinterpret_cast<uint32_t*>(mainRintSpvData), mainRintSpvSize));
+	log(fmt::format("{} instances of {} unique subtrees", nodes.size(), subtreeGlsl.size()));
+	trimShaderCache(); // only keep the shaders of this scene for the next regenerate
+
+	// store the attributes of every aabb in a storage buffer read by the intersection shaders
+	createBuffer(std::max<size_t>(attributes.size(), 1) * sizeof(ModelAttributes),
+		vk::BufferUsageFlagBits::eStorageBuffer,
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		&attributeBuffer, &attributeMemory);
+	if (!attributes.empty()) writeToDevice(attributeMemory, attributes.data(), attributes.size() * sizeof(ModelAttributes));
 
 	// create pipeline
 	createAcceleratedPipeline(intersectionShaders);
@@ -364,8 +555,27 @@ void Primrose::generateAcceleratedScene(Scene& scene) {
 	createShaderTable(intersectionShaders.size() + 2);
 
 	// create acceleration structure
-	createBottomAccelerationStructure(aabbData, aabbAttributes, &aabbStructure, &aabbStructureBuffer, &aabbStructureMemory);
-	createTopAccelerationStructure(aabbStructure, &topStructure, &topStructureBuffer, &topStructureMemory);
+	writeInstances(nodes, instanceSubtrees);
+	buildTopAccelerationStructure(nodes.size(), TopBuild::CREATE);
+}
+
+void Primrose::updateAcceleratedScene(Scene& scene) {
+	std::vector<std::string> glsl;
+	std::vector<Node*> nodes;
+	std::vector<uint> subtrees;
+	findSubtrees(scene, glsl, nodes, subtrees);
+
+	// only root transforms changed, so the blas, shaders and shader table still match, the pipeline is only
+	// rebuilt with the scene so it also has to have the current quality
+	if (glsl == subtreeGlsl && subtrees == instanceSubtrees && quality == pipelineQuality) {
+		writeInstances(nodes, subtrees);
+		buildTopAccelerationStructure(nodes.size(),
+			topRefits < Settings::maxTopRefits ? TopBuild::REFIT : TopBuild::REBUILD);
+		return;
+	}
+
+	destroyAcceleratedScene();
+	generateAcceleratedScene(scene);
 }
 
 void Primrose::destroyAcceleratedScene() {
@@ -375,9 +585,20 @@ void Primrose::destroyAcceleratedScene() {
 	device.destroyBuffer(topStructureBuffer);
 	device.freeMemory(topStructureMemory);
 
-	device.destroyAccelerationStructureKHR(aabbStructure);
-	device.destroyBuffer(aabbStructureBuffer);
-	device.freeMemory(aabbStructureMemory);
+	for (const auto& blas : bottomStructures) {
+		device.destroyAccelerationStructureKHR(blas.structure);
+		device.destroyBuffer(blas.buffer);
+		device.freeMemory(blas.memory);
+	}
+	bottomStructures.clear();
+
+	device.destroyBuffer(attributeBuffer);
+	device.freeMemory(attributeMemory);
+	attributeBuffer = VK_NULL_HANDLE;
+	attributeMemory = VK_NULL_HANDLE;
+	structureMemory.bottom = 0;
+	structureMemory.bottomUncompacted = 0;
+	structureMemory.top = 0;
 
 	device.destroyBuffer(rayShaderTable);
 	device.freeMemory(rayShaderTableMemory);
@@ -0,0 +1,179 @@
+#define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
+#include "engine/pipeline_compute.hpp"
+#include "engine/setup.hpp"
+#include "log.hpp"
+#include "state.hpp"
+#include "embed/march_comp_spv.h"
+#include "embed/resolve_comp_spv.h"
+#include "embed/cone_comp_spv.h"
+#include "embed/shade_comp_spv.h"
+#include "embed/bounce_comp_spv.h"
+#include "embed/composite_comp_spv.h"
+#include "embed/upsample_comp_spv.h"
+#include "embed/bake_comp_spv.h"
+#include "embed/clipmap_comp_spv.h"
+
+#include <vulkan/vulkan.hpp>
+#include <stdexcept>
+
+void Primrose::createComputePipelineLayout() {
+	log("Creating compute pipeline layout");
+
+	std::vector<vk::PushConstantRange> pushRanges = {
+		vk::PushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, 128) // 128 bytes is min supported push size
+	};
+
+	std::array<vk::DescriptorSetLayoutBinding, 21> bindings = {
+		vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eCombinedImageSampler, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		// history: previous colour and depth, current colour and depth, motion vectors
+		vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(5, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(6, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(7, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		// cone pre-pass start distances
+		vk::DescriptorSetLayoutBinding(8, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		// step statistics
+		vk::DescriptorSetLayoutBinding(9, vk::DescriptorType::eStorageBuffer, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		// g-buffer surfaces
+		vk::DescriptorSetLayoutBinding(10, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		// bounce queue: rays, counters, per pixel list heads and counts, blended bounces
+		vk::DescriptorSetLayoutBinding(11, vk::DescriptorType::eStorageBuffer, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(12, vk::DescriptorType::eStorageBuffer, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(13, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(14, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(15, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		// brick cache: atlas, cells, and the bake pass's staging samples
+		vk::DescriptorSetLayoutBinding(16, vk::DescriptorType::eCombinedImageSampler, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(17, vk::DescriptorType::eStorageBuffer, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(18, vk::DescriptorType::eStorageBuffer, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		// distance clipmap around the camera
+		vk::DescriptorSetLayoutBinding(19, vk::DescriptorType::eStorageImage, 1,
+			vk::ShaderStageFlagBits::eCompute),
+		// noise volume of procedural primitives
+		vk::DescriptorSetLayoutBinding(20, vk::DescriptorType::eCombinedImageSampler, 1,
+			vk::ShaderStageFlagBits::eCompute),
+	};
+	vk::DescriptorSetLayoutCreateInfo descLayoutInfo(
+		vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR, bindings);
+	mainDescriptorLayout = device.createDescriptorSetLayout(descLayoutInfo);
+
+	vk::PipelineLayoutCreateInfo layoutInfo({}, mainDescriptorLayout, pushRanges);
+	mainPipelineLayout = device.createPipelineLayout(layoutInfo);
+}
+
+void Primrose::createComputePipeline() {
+	log("Creating compute pipeline");
+
+	vk::ShaderModule compModule = createShaderModule(reinterpret_cast<uint32_t*>(marchCompSpvData), marchCompSpvSize);
+	vk::ShaderModule resolveModule = createShaderModule(
+		reinterpret_cast<uint32_t*>(resolveCompSpvData), resolveCompSpvSize);
+	vk::ShaderModule coneModule = createShaderModule(reinterpret_cast<uint32_t*>(coneCompSpvData), coneCompSpvSize);
+	vk::ShaderModule shadeModule = createShaderModule(reinterpret_cast<uint32_t*>(shadeCompSpvData), shadeCompSpvSize);
+	vk::ShaderModule bounceModule = createShaderModule(
+		reinterpret_cast<uint32_t*>(bounceCompSpvData), bounceCompSpvSize);
+	vk::ShaderModule compositeModule = createShaderModule(
+		reinterpret_cast<uint32_t*>(compositeCompSpvData), compositeCompSpvSize);
+	vk::ShaderModule upsampleModule = createShaderModule(
+		reinterpret_cast<uint32_t*>(upsampleCompSpvData), upsampleCompSpvSize);
+	vk::ShaderModule bakeModule = createShaderModule(reinterpret_cast<uint32_t*>(bakeCompSpvData), bakeCompSpvSize);
+	vk::ShaderModule clipmapModule = createShaderModule(
+		reinterpret_cast<uint32_t*>(clipmapCompSpvData), clipmapCompSpvSize);
+
+	vk::SpecializationInfo specialization = quality.specializationInfo();
+
+	// all share the march layout, so one push descriptor set serves every dispatch of a frame
+	std::array<vk::ComputePipelineCreateInfo, 9> pipelineInfos = {
+		vk::ComputePipelineCreateInfo({},
+			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, compModule, "main",
+				&specialization),
+			mainPipelineLayout),
+		vk::ComputePipelineCreateInfo({},
+			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, resolveModule, "main",
+				&specialization),
+			mainPipelineLayout),
+		vk::ComputePipelineCreateInfo({},
+			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, coneModule, "main",
+				&specialization),
+			mainPipelineLayout),
+		vk::ComputePipelineCreateInfo({},
+			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, shadeModule, "main",
+				&specialization),
+			mainPipelineLayout),
+		vk::ComputePipelineCreateInfo({},
+			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, bounceModule, "main",
+				&specialization),
+			mainPipelineLayout),
+		vk::ComputePipelineCreateInfo({},
+			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, compositeModule, "main",
+				&specialization),
+			mainPipelineLayout),
+		vk::ComputePipelineCreateInfo({},
+			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, upsampleModule, "main",
+				&specialization),
+			mainPipelineLayout),
+		vk::ComputePipelineCreateInfo({},
+			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, bakeModule, "main",
+				&specialization),
+			mainPipelineLayout),
+		vk::ComputePipelineCreateInfo({},
+			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, clipmapModule, "main",
+				&specialization),
+			mainPipelineLayout)
+	};
+
+	auto res = device.createComputePipelines(pipelineCache, pipelineInfos);
+	if (res.result != vk::Result::eSuccess) throw std::runtime_error("failed to create compute pipelines");
+	mainPipeline = res.value[0];
+	resolvePipeline = res.value[1];
+	conePipeline = res.value[2];
+	shadePipeline = res.value[3];
+	bouncePipeline = res.value[4];
+	compositePipeline = res.value[5];
+	upsamplePipeline = res.value[6];
+	bakePipeline = res.value[7];
+	clipmapPipeline = res.value[8];
+
+	device.destroyShaderModule(compModule);
+	device.destroyShaderModule(resolveModule);
+	device.destroyShaderModule(coneModule);
+	device.destroyShaderModule(shadeModule);
+	device.destroyShaderModule(bounceModule);
+	device.destroyShaderModule(compositeModule);
+	device.destroyShaderModule(upsampleModule);
+	device.destroyShaderModule(bakeModule);
+	device.destroyShaderModule(clipmapModule);
+}
+
+void Primrose::destroyComputePipeline() {
+	// mainPipeline belongs to whichever backend is active, so it is destroyed by the caller
+	device.destroyPipeline(resolvePipeline);
+	device.destroyPipeline(conePipeline);
+	device.destroyPipeline(shadePipeline);
+	device.destroyPipeline(bouncePipeline);
+	device.destroyPipeline(compositePipeline);
+	device.destroyPipeline(upsamplePipeline);
+	device.destroyPipeline(bakePipeline);
+	device.destroyPipeline(clipmapPipeline);
+}
@@ -13,11 +13,13 @@ void Primrose::createGraphicsPipelineLayout(vk::PipelineLayout* pipelineLayout,
 		vk::PushConstantRange(vk::ShaderStageFlagBits::eFragment, 0, 128) // 128 bytes is min supported push size
 	};
 
-	std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {
+	std::array<vk::DescriptorSetLayoutBinding, 3> bindings = {
 		vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1,
 			vk::ShaderStageFlagBits::eFragment),
 		vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eCombinedImageSampler, 1,
 			vk::ShaderStageFlagBits::eFragment),
+		vk::DescriptorSetLayoutBinding(20, vk::DescriptorType::eCombinedImageSampler, 1,
+			vk::ShaderStageFlagBits::eFragment), // noise volume of procedural primitives
 	};
 
 	vk::DescriptorSetLayoutCreateInfo descLayoutInfo(
@@ -30,7 +32,7 @@ void Primrose::createGraphicsPipelineLayout(vk::PipelineLayout* pipelineLayout,
 
 void Primrose::createGraphicsPipeline(vk::ShaderModule vertModule, vk::ShaderModule fragModule,
 	vk::PipelineVertexInputStateCreateInfo vertInputInfo, vk::PipelineInputAssemblyStateCreateInfo assemblyInfo,
-	vk::PipelineLayout pipelineLayout, vk::Pipeline* pipeline) {
+	vk::PipelineLayout pipelineLayout, vk::Pipeline* pipeline, const vk::SpecializationInfo* fragSpecialization) {
 
 	// shaders
 	vk::PipelineShaderStageCreateInfo vertStageInfo{};
@@ -43,7 +45,7 @@ void Primrose::createGraphicsPipeline(vk::ShaderModule vertModule, vk::ShaderMod
 	fragStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
 	fragStageInfo.pName = "main";
 	fragStageInfo.module = fragModule;
-	fragStageInfo.pSpecializationInfo = nullptr;
+	fragStageInfo.pSpecializationInfo = fragSpecialization;
 
 	vk::PipelineShaderStageCreateInfo shaderStagesInfo[] = {vertStageInfo, fragStageInfo};
 
@@ -120,7 +122,7 @@ void Primrose::createGraphicsPipeline(vk::ShaderModule vertModule, vk::ShaderMod
 	pipelineInfo.pStages = shaderStagesInfo;
 	pipelineInfo.subpass = 0;
 
-	auto res = device.createGraphicsPipeline(VK_NULL_HANDLE, pipelineInfo);
+	auto res = device.createGraphicsPipeline(pipelineCache, pipelineInfo);
 	if (res.result != vk::Result::eSuccess) throw std::runtime_error("failed to create graphics pipeline");
 	*pipeline = res.value;
 }
@@ -147,8 +149,10 @@ void Primrose::createRasterPipeline() {
 	assemblyInfo.topology = vk::PrimitiveTopology::eTriangleList; // one triangle every 3 vertices
 	assemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-	// create pipeline
-	createGraphicsPipeline(vertModule, fragModule, vertInputInfo, assemblyInfo, mainPipelineLayout, &mainPipeline);
+	// create pipeline, the march shader is specialised for the current quality
+	vk::SpecializationInfo specialization = quality.specializationInfo();
+	createGraphicsPipeline(vertModule, fragModule, vertInputInfo, assemblyInfo, mainPipelineLayout, &mainPipeline,
+		&specialization);
 
 	// cleanup
 	device.destroyShaderModule(vertModule);
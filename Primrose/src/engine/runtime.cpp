@@ -1,11 +1,154 @@
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #include "engine/runtime.hpp"
+#include "engine/pipeline_compute.hpp"
 #include "state.hpp"
 #include "log.hpp"
 
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+	using namespace Primrose;
+
+	static void updateRenderScale(FrameInFlight& frame) {
+		if (targetFrameTime <= 0.f || !traceBlit || timestampPeriod == 0.f) {
+			renderScale = 1.f;
+		} else if (frame.timestampsWritten) {
+			// the fence has been waited on, so this frame's last timestamps are ready
+			auto res = device.getQueryPoolResults<uint64_t>(frame.timestampPool, 0, 2,
+				2 * sizeof(uint64_t), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+
+			if (res.result == vk::Result::eSuccess) {
+				float gpuTime = static_cast<float>(res.value[1] - res.value[0]) * timestampPeriod * 1e-6f; // ms
+
+				// march cost scales with pixel count, ie with the square of the scale
+				float idealScale = renderScale * std::sqrt(targetFrameTime / std::max(gpuTime, 0.01f));
+				// only move part of the way, the measured frame lags behind by the frames in flight
+				renderScale = std::clamp(renderScale + (idealScale - renderScale) * 0.1f, Settings::minRenderScale, 1.f);
+			}
+		}
+
+		// round to whole tiles so the extent doesn't flicker between neighbouring sizes
+		auto scaled = [](uint32_t size) {
+			uint32_t tiles = static_cast<uint32_t>(std::round(static_cast<float>(size) * renderScale / MARCH_TILE_SIZE));
+			return std::clamp(tiles * MARCH_TILE_SIZE, 1u, size);
+		};
+		renderExtent = renderScale == 1.f ? swapchainExtent
+			: vk::Extent2D(scaled(swapchainExtent.width), scaled(swapchainExtent.height));
+	}
+
+	static void readMarchStats(FrameInFlight& frame) {
+		if (!computeMarch) return;
+
+		// the fence has been waited on, so the stats of this frame in flight's last use are complete
+		MarchStats stats{};
+		readFromDevice(frame.statsBufferMemory, &stats, sizeof(stats));
+		if (stats.rays > 0) marchStepsPerPixel = static_cast<float>(stats.steps) / static_cast<float>(stats.rays);
+		droppedBounces = stats.bouncesQueued > bounceCapacity ? stats.bouncesQueued - bounceCapacity : 0;
+
+		MarchStats zero{};
+		writeToDevice(frame.statsBufferMemory, &zero, sizeof(zero));
+	}
+
+	struct ClipmapUpdate { // box of one level's texels, matches the push constants of clipmap.comp
+		glm::ivec3 regionMin;
+		uint level;
+		glm::uvec3 regionSize;
+	};
+	static std::vector<ClipmapUpdate> clipmapUpdates; // recorded into the next compute frame
+
+	// recentres each clipmap level on the camera, queueing the texels that wrapped around to the other side
+	static void updateClipmap() {
+		clipmapUpdates.clear();
+		if (!computeMarch) return;
+
+		int size = static_cast<int>(Settings::clipmapResolution);
+		float texel = uniforms.clipmapTexel;
+		for (uint level = 0; level < uniforms.clipmapLevels; ++level, texel *= 2.f) {
+			glm::ivec3 origin = glm::ivec3(glm::floor(uniforms.camPos / texel)) - size / 2;
+			glm::ivec3 shift = origin - uniforms.clipmapOrigins[level];
+			uniforms.clipmapOrigins[level] = origin;
+
+			if (!clipmapValid || glm::any(glm::greaterThanEqual(glm::abs(shift), glm::ivec3(size)))) {
+				clipmapUpdates.push_back({origin, level, glm::uvec3(size)});
+				continue;
+			}
+
+			// a slab for each axis the level moved along, the corners where slabs meet are updated twice
+			for (int axis = 0; axis < 3; ++axis) {
+				if (shift[axis] == 0) continue;
+				ClipmapUpdate slab = {origin, level, glm::uvec3(size)};
+				slab.regionSize[axis] = std::abs(shift[axis]);
+				if (shift[axis] > 0) slab.regionMin[axis] += size - shift[axis];
+				clipmapUpdates.push_back(slab);
+			}
+		}
+		clipmapValid = true;
+	}
+
+	static void prepareTraceTarget(vk::CommandBuffer commandBuffer, uint32_t imageIndex, bool direct,
+		vk::PipelineStageFlags stage) {
+
+		if (direct) {
+			// swap image: undefined -> general, so the trace shader can write to it
+			transitionImageLayout(swapchainFrames[imageIndex].image, commandBuffer,
+				vk::ImageLayout::eUndefined, vk::AccessFlagBits::eNone, vk::PipelineStageFlagBits::eTopOfPipe,
+				vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite, stage);
+		}
+	}
+
+	static void presentTraceTarget(vk::CommandBuffer commandBuffer, uint32_t imageIndex, bool direct,
+		vk::PipelineStageFlags stage) {
+
+		if (direct) {
+			// swap image: general -> present src, which the render pass expects as its initial layout
+			transitionImageLayout(swapchainFrames[imageIndex].image, commandBuffer,
+				vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite, stage,
+				vk::ImageLayout::ePresentSrcKHR,
+				vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+				vk::PipelineStageFlagBits::eColorAttachmentOutput);
+			return;
+		}
+
+		// transition images to prepare for blit
+		transitionImageLayout(swapchainFrames[imageIndex].image, commandBuffer, // swap image: undefined -> transfer dst
+			vk::ImageLayout::eUndefined, vk::AccessFlagBits::eNone, vk::PipelineStageFlagBits::eTopOfPipe,
+			vk::ImageLayout::eTransferDstOptimal, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer);
+		transitionImageLayout(traceImage, commandBuffer, // traceImage: general -> transfer src
+			vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite, stage,
+			vk::ImageLayout::eTransferSrcOptimal, vk::AccessFlagBits::eTransferRead, vk::PipelineStageFlagBits::eTransfer);
+
+		// blit the marched corner of traceImage to swap image, upscaling and converting from the half float format
+		std::array<vk::Offset3D, 2> srcRegion = {
+			vk::Offset3D(0, 0, 0),
+			vk::Offset3D(static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1)
+		};
+		std::array<vk::Offset3D, 2> dstRegion = {
+			vk::Offset3D(0, 0, 0),
+			vk::Offset3D(static_cast<int32_t>(swapchainExtent.width), static_cast<int32_t>(swapchainExtent.height), 1)
+		};
+		vk::ImageBlit imgBlit(
+			vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1), srcRegion,
+			vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1), dstRegion);
+		commandBuffer.blitImage(traceImage, vk::ImageLayout::eTransferSrcOptimal,
+			swapchainFrames[imageIndex].image, vk::ImageLayout::eTransferDstOptimal, imgBlit,
+			renderExtent == swapchainExtent ? vk::Filter::eNearest : vk::Filter::eLinear);
+
+		// transition images back to normal
+		transitionImageLayout(swapchainFrames[imageIndex].image, commandBuffer, // swap image: transfer dst -> present src
+			vk::ImageLayout::eTransferDstOptimal, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer,
+			vk::ImageLayout::ePresentSrcKHR, vk::AccessFlagBits::eNone, vk::PipelineStageFlagBits::eBottomOfPipe);
+		transitionImageLayout(traceImage, commandBuffer, // traceImage: transfer src -> general
+			vk::ImageLayout::eTransferSrcOptimal, vk::AccessFlagBits::eTransferRead, vk::PipelineStageFlagBits::eTransfer,
+			vk::ImageLayout::eGeneral, vk::AccessFlagBits::eNone, vk::PipelineStageFlagBits::eBottomOfPipe);
+	}
+}
 
 void Primrose::setFov(float newFov) {
 	fov = newFov;
@@ -15,6 +158,34 @@ void Primrose::setZoom(float newZoom) {
 	zoom = newZoom;
 	uniforms.invZoom = 1.f / zoom;
 }
+void Primrose::setTargetFrameTime(float milliseconds) {
+	targetFrameTime = milliseconds;
+	if (targetFrameTime <= 0.f) renderScale = 1.f;
+}
+void Primrose::setInterleave(unsigned int pixels) {
+	if (pixels != 1 && pixels != 2 && pixels != 4) throw std::runtime_error("interleave must be 1, 2 or 4");
+	// only the compute backend has the history and resolve pass needed to fill in skipped pixels
+	interleave = computeMarch ? pixels : 1;
+}
+void Primrose::setBounceScale(unsigned int scale) {
+	if (scale != 1 && scale != 2 && scale != 4) throw std::runtime_error("bounce scale must be 1, 2 or 4");
+	// the fragment and ray tracing backends bounce inside each pixel's own invocation
+	bounceScale = computeMarch ? scale : 1;
+}
+void Primrose::setQualityPreset(QUALITY preset) {
+	QualitySettings settings = QualitySettings::preset(preset);
+	settings.debugBackground = quality.debugBackground;
+	setQuality(settings);
+}
+void Primrose::setQuality(QualitySettings settings) {
+	settings.maxBounces = std::min(settings.maxBounces, MAX_BOUNCE_LEVELS);
+	quality = settings;
+	recreatePipelines();
+}
+void Primrose::setRelaxation(float omega) {
+	// past 2 the backtracking step no longer lands inside the last sphere
+	uniforms.relaxation = std::clamp(omega, 1.f, 1.9f);
+}
 
 void Primrose::run(void(*callback)(float)) {
 	log("Starting main loop");
@@ -43,6 +214,16 @@ void Primrose::recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t ima
 	vk::CommandBufferBeginInfo beginInfo{};
 	commandBuffer.begin(beginInfo);
 
+	if (timestampPeriod != 0.f) {
+		commandBuffer.resetQueryPool(currentFlight.timestampPool, 0, 2);
+		commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, currentFlight.timestampPool, 0);
+	}
+
+	if (!bricksBaked) bakeBricks(commandBuffer, currentFlight);
+
+	// trace straight into the swap image, unless upscaling from a lower render scale
+	bool direct = traceDirect && renderExtent == swapchainExtent;
+
 	vk::RenderPassBeginInfo renderBeginInfo{};
 	renderBeginInfo.renderPass = renderPass;
 	renderBeginInfo.framebuffer = swapchainFrames[imageIndex].framebuffer;
@@ -56,16 +237,18 @@ void Primrose::recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t ima
 
 	if (rayAcceleration) {
 		// descriptor sets
-		std::array<vk::WriteDescriptorSet, 4> descriptorWrites = {
+		std::array<vk::WriteDescriptorSet, 6> descriptorWrites = {
 			vk::WriteDescriptorSet(VK_NULL_HANDLE, 0, 0, 1, vk::DescriptorType::eAccelerationStructureKHR),
 			vk::WriteDescriptorSet(VK_NULL_HANDLE, 1, 0, 1, vk::DescriptorType::eStorageImage),
 			vk::WriteDescriptorSet(VK_NULL_HANDLE, 2, 0, 1, vk::DescriptorType::eUniformBuffer),
-			vk::WriteDescriptorSet(VK_NULL_HANDLE, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler)
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 4, 0, 1, vk::DescriptorType::eStorageBuffer),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 20, 0, 1, vk::DescriptorType::eCombinedImageSampler)
 		};
 		vk::WriteDescriptorSetAccelerationStructureKHR accWrite(1, &topStructure);
 		descriptorWrites[0].pNext = &accWrite;
 		vk::DescriptorImageInfo traceImgInfo = vk::DescriptorImageInfo(VK_NULL_HANDLE,
-			traceImageView, vk::ImageLayout::eGeneral);
+			direct ? swapchainFrames[imageIndex].storageView : traceImageView, vk::ImageLayout::eGeneral);
 		descriptorWrites[1].pImageInfo = &traceImgInfo;
 
 		vk::DescriptorBufferInfo ubInfo = vk::DescriptorBufferInfo(
@@ -74,6 +257,11 @@ void Primrose::recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t ima
 		vk::DescriptorImageInfo texInfo = vk::DescriptorImageInfo(marchSampler, marchImageView,
 			vk::ImageLayout::eShaderReadOnlyOptimal);
 		descriptorWrites[3].pImageInfo = &texInfo;
+		vk::DescriptorBufferInfo attributeInfo(attributeBuffer, 0, VK_WHOLE_SIZE);
+		descriptorWrites[4].pBufferInfo = &attributeInfo;
+		vk::DescriptorImageInfo noiseInfo = vk::DescriptorImageInfo(noiseSampler, noiseVolumeView,
+			vk::ImageLayout::eShaderReadOnlyOptimal);
+		descriptorWrites[5].pImageInfo = &noiseInfo;
 
 		commandBuffer.pushDescriptorSetKHR(vk::PipelineBindPoint::eRayTracingKHR,
 			mainPipelineLayout, 0, descriptorWrites);
@@ -81,6 +269,8 @@ void Primrose::recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t ima
 		// push constants
 		PushConstants push{};
 		push.time = glfwGetTime();
+		push.encodeSrgb = direct && traceSrgbEncode;
+		push.extent = glm::uvec2(renderExtent.width, renderExtent.height);
 		commandBuffer.pushConstants(mainPipelineLayout, vk::ShaderStageFlagBits::eRaygenKHR, 0,
 			sizeof(PushConstants), &push); // cmd: set push constants
 
@@ -88,32 +278,226 @@ void Primrose::recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t ima
 		commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, mainPipeline);
 
 		// draw
+		prepareTraceTarget(commandBuffer, imageIndex, direct, vk::PipelineStageFlagBits::eRayTracingShaderKHR);
 		commandBuffer.traceRaysKHR(genGroupAddress, missGroupAddress, hitGroupAddress, callableGroupAddress,
-			swapchainExtent.width, swapchainExtent.height, 1);
+			renderExtent.width, renderExtent.height, 1);
+		presentTraceTarget(commandBuffer, imageIndex, direct, vk::PipelineStageFlagBits::eRayTracingShaderKHR);
 
-		// transition images to prepare for copy
-		transitionImageLayout(swapchainFrames[imageIndex].image, commandBuffer, // swap image: undefined -> transfer dst
-			vk::ImageLayout::eUndefined, vk::AccessFlagBits::eNone, vk::PipelineStageFlagBits::eTopOfPipe,
-			vk::ImageLayout::eTransferDstOptimal, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer);
-		transitionImageLayout(traceImage, commandBuffer, // traceImage: general -> transfer src
-			vk::ImageLayout::eGeneral, vk::AccessFlagBits::eNone, vk::PipelineStageFlagBits::eRayTracingShaderKHR,
-			vk::ImageLayout::eTransferSrcOptimal, vk::AccessFlagBits::eTransferRead, vk::PipelineStageFlagBits::eTransfer);
+		// begin render pass
+		commandBuffer.beginRenderPass(renderBeginInfo, vk::SubpassContents::eInline); // cmd: begin render pass
+	} else if (computeMarch) {
+		// descriptor sets
+		std::array<vk::WriteDescriptorSet, 20> descriptorWrites = {
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 0, 0, 1, vk::DescriptorType::eUniformBuffer),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 2, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 3, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 4, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 5, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 6, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 7, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 8, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 9, 0, 1, vk::DescriptorType::eStorageBuffer),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 10, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 11, 0, 1, vk::DescriptorType::eStorageBuffer),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 12, 0, 1, vk::DescriptorType::eStorageBuffer),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 13, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 14, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 15, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 16, 0, 1, vk::DescriptorType::eCombinedImageSampler),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 17, 0, 1, vk::DescriptorType::eStorageBuffer),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 19, 0, 1, vk::DescriptorType::eStorageImage),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 20, 0, 1, vk::DescriptorType::eCombinedImageSampler)
+		};
+		vk::DescriptorBufferInfo ubInfo = vk::DescriptorBufferInfo(
+			currentFlight.uniformBuffer, 0, sizeof(MarchUniforms));
+		descriptorWrites[0].pBufferInfo = &ubInfo;
+		vk::DescriptorImageInfo texInfo = vk::DescriptorImageInfo(marchSampler, marchImageView,
+			vk::ImageLayout::eShaderReadOnlyOptimal);
+		descriptorWrites[1].pImageInfo = &texInfo;
+		vk::DescriptorImageInfo traceImgInfo = vk::DescriptorImageInfo(VK_NULL_HANDLE,
+			direct ? swapchainFrames[imageIndex].storageView : traceImageView, vk::ImageLayout::eGeneral);
+		descriptorWrites[2].pImageInfo = &traceImgInfo;
+
+		// history images swap roles every frame
+		uint32_t current = frameIndex % 2;
+		uint32_t previous = 1 - current;
+		std::array<vk::DescriptorImageInfo, 5> historyInfos = {
+			vk::DescriptorImageInfo(VK_NULL_HANDLE, historyColorImages[previous].view, vk::ImageLayout::eGeneral),
+			vk::DescriptorImageInfo(VK_NULL_HANDLE, historyDepthImages[previous].view, vk::ImageLayout::eGeneral),
+			vk::DescriptorImageInfo(VK_NULL_HANDLE, historyColorImages[current].view, vk::ImageLayout::eGeneral),
+			vk::DescriptorImageInfo(VK_NULL_HANDLE, historyDepthImages[current].view, vk::ImageLayout::eGeneral),
+			vk::DescriptorImageInfo(VK_NULL_HANDLE, motionImage.view, vk::ImageLayout::eGeneral)
+		};
+		for (size_t i = 0; i < historyInfos.size(); ++i) descriptorWrites[3 + i].pImageInfo = &historyInfos[i];
+		vk::DescriptorImageInfo coneInfo = vk::DescriptorImageInfo(VK_NULL_HANDLE, coneImage.view,
+			vk::ImageLayout::eGeneral);
+		descriptorWrites[8].pImageInfo = &coneInfo;
+		vk::DescriptorBufferInfo statsInfo = vk::DescriptorBufferInfo(currentFlight.statsBuffer, 0, sizeof(MarchStats));
+		descriptorWrites[9].pBufferInfo = &statsInfo;
+		vk::DescriptorImageInfo surfaceInfo = vk::DescriptorImageInfo(VK_NULL_HANDLE, surfaceImage.view,
+			vk::ImageLayout::eGeneral);
+		descriptorWrites[10].pImageInfo = &surfaceInfo;
+		vk::DescriptorBufferInfo bounceRayInfo = vk::DescriptorBufferInfo(bounceRayBuffer, 0, VK_WHOLE_SIZE);
+		descriptorWrites[11].pBufferInfo = &bounceRayInfo;
+		vk::DescriptorBufferInfo bounceCounterInfo = vk::DescriptorBufferInfo(bounceCounterBuffer, 0,
+			sizeof(BounceCounters));
+		descriptorWrites[12].pBufferInfo = &bounceCounterInfo;
+		std::array<vk::DescriptorImageInfo, 3> bounceImageInfos = {
+			vk::DescriptorImageInfo(VK_NULL_HANDLE, bounceHeadImage.view, vk::ImageLayout::eGeneral),
+			vk::DescriptorImageInfo(VK_NULL_HANDLE, bounceCountImage.view, vk::ImageLayout::eGeneral),
+			vk::DescriptorImageInfo(VK_NULL_HANDLE, bounceImage.view, vk::ImageLayout::eGeneral)
+		};
+		for (size_t i = 0; i < bounceImageInfos.size(); ++i) descriptorWrites[13 + i].pImageInfo = &bounceImageInfos[i];
+		vk::DescriptorImageInfo brickAtlasInfo = vk::DescriptorImageInfo(brickSampler, brickAtlasView,
+			vk::ImageLayout::eShaderReadOnlyOptimal);
+		descriptorWrites[16].pImageInfo = &brickAtlasInfo;
+		vk::DescriptorBufferInfo brickCacheInfo = vk::DescriptorBufferInfo(brickCacheBuffer, 0, VK_WHOLE_SIZE);
+		descriptorWrites[17].pBufferInfo = &brickCacheInfo;
+		vk::DescriptorImageInfo clipmapInfo = vk::DescriptorImageInfo(VK_NULL_HANDLE, clipmapView,
+			vk::ImageLayout::eGeneral);
+		descriptorWrites[18].pImageInfo = &clipmapInfo;
+		vk::DescriptorImageInfo noiseInfo = vk::DescriptorImageInfo(noiseSampler, noiseVolumeView,
+			vk::ImageLayout::eShaderReadOnlyOptimal);
+		descriptorWrites[19].pImageInfo = &noiseInfo;
 
-		// copy image from traceImage to swap image
-		vk::ImageCopy imgCopy(
-			vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1), vk::Offset3D(0, 0, 0), // src format
-			vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1), vk::Offset3D(0, 0, 0), // dst format
-			vk::Extent3D(swapchainExtent, 1)); // image size
-		commandBuffer.copyImage(traceImage, vk::ImageLayout::eTransferSrcOptimal,
-			swapchainFrames[imageIndex].image, vk::ImageLayout::eTransferDstOptimal, imgCopy);
+		commandBuffer.pushDescriptorSetKHR(vk::PipelineBindPoint::eCompute, mainPipelineLayout, 0, descriptorWrites);
 
-		// transition images back to normal
-		transitionImageLayout(swapchainFrames[imageIndex].image, commandBuffer, // swap image: transfer dst -> present src
-			vk::ImageLayout::eTransferDstOptimal, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer,
-			vk::ImageLayout::ePresentSrcKHR, vk::AccessFlagBits::eNone, vk::PipelineStageFlagBits::eBottomOfPipe);
-		transitionImageLayout(traceImage, commandBuffer, // traceImage: transfer src -> general
-			vk::ImageLayout::eTransferSrcOptimal, vk::AccessFlagBits::eTransferRead, vk::PipelineStageFlagBits::eTransfer,
-			vk::ImageLayout::eGeneral, vk::AccessFlagBits::eNone, vk::PipelineStageFlagBits::eBottomOfPipe);
+		if (!clipmapUpdates.empty()) {
+			// refill the texels the camera scrolled into, once last frame's march is done reading them
+			vk::MemoryBarrier clipmapReuseBarrier(vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eShaderWrite);
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+				vk::PipelineStageFlagBits::eComputeShader, {}, clipmapReuseBarrier, {}, {});
+
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, clipmapPipeline);
+			for (const ClipmapUpdate& update : clipmapUpdates) {
+				commandBuffer.pushConstants(mainPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0,
+					sizeof(ClipmapUpdate), &update);
+				commandBuffer.dispatch((update.regionSize.x + 3) / 4, (update.regionSize.y + 3) / 4,
+					(update.regionSize.z + 3) / 4);
+			}
+		}
+
+		// history is only reused at the same resolution it was marched at
+		if (renderExtent != historyExtent) historyValid = false;
+
+		// push constants
+		PushConstants push{};
+		push.time = glfwGetTime();
+		push.encodeSrgb = direct && traceSrgbEncode;
+		push.extent = glm::uvec2(renderExtent.width, renderExtent.height);
+		push.frameIndex = frameIndex;
+		push.historyValid = historyValid;
+		push.historyRefresh = historyRefresh;
+		push.interleave = interleave;
+		push.bounceScale = bounceScale;
+		commandBuffer.pushConstants(mainPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0,
+			sizeof(PushConstants), &push); // cmd: set push constants
+
+		historyValid = true;
+		historyExtent = renderExtent;
+
+		// last frame's history writes must land before this frame reads them, as must the clipmap updates
+		vk::MemoryBarrier historyBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eComputeShader, {}, historyBarrier, {}, {});
+
+		// empty the bounce queue once last frame's bounce passes are done with it
+		BounceCounters counters{};
+		counters.capacity = bounceCapacity;
+		for (auto& groups : counters.levelGroups) groups = vk::DispatchIndirectCommand(0, 1, 1);
+		vk::MemoryBarrier queueReuseBarrier(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eIndirectCommandRead
+			| vk::AccessFlagBits::eTransferRead, vk::AccessFlagBits::eTransferWrite);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader
+			| vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eTransfer, {}, queueReuseBarrier, {}, {});
+		commandBuffer.updateBuffer(bounceCounterBuffer, 0, sizeof(BounceCounters), &counters);
+		vk::MemoryBarrier queueResetBarrier(vk::AccessFlagBits::eTransferWrite,
+			vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eComputeShader, {}, queueResetBarrier, {}, {});
+
+		// cone pre-pass, one thread per cell of pixels
+		uint32_t cellsWidth = (renderExtent.width + CONE_CELL_SIZE - 1) / CONE_CELL_SIZE;
+		uint32_t cellsHeight = (renderExtent.height + CONE_CELL_SIZE - 1) / CONE_CELL_SIZE;
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, conePipeline);
+		commandBuffer.dispatch((cellsWidth + MARCH_TILE_SIZE - 1) / MARCH_TILE_SIZE,
+			(cellsHeight + MARCH_TILE_SIZE - 1) / MARCH_TILE_SIZE, 1);
+
+		// the march reads the start distances written by the cone pass
+		vk::MemoryBarrier coneBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eComputeShader, {}, coneBarrier, {}, {});
+
+		// bind pipeline
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, mainPipeline);
+
+		// draw, one workgroup per screen tile, threads are compacted onto the marched pixels when interleaving
+		uint32_t marchedWidth = interleave == 1 ? renderExtent.width : (renderExtent.width + 1) / 2;
+		uint32_t marchedHeight = interleave == 4 ? (renderExtent.height + 1) / 2 : renderExtent.height;
+		uint32_t marchedGroupsX = (marchedWidth + MARCH_TILE_SIZE - 1) / MARCH_TILE_SIZE;
+		uint32_t marchedGroupsY = (marchedHeight + MARCH_TILE_SIZE - 1) / MARCH_TILE_SIZE;
+		prepareTraceTarget(commandBuffer, imageIndex, direct, vk::PipelineStageFlagBits::eComputeShader);
+		commandBuffer.dispatch(marchedGroupsX, marchedGroupsY, 1);
+
+		// light the g-buffer over the same pixels, queueing the first level of bounces
+		vk::MemoryBarrier gbufferBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eComputeShader, {}, gbufferBarrier, {}, {});
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, shadePipeline);
+		commandBuffer.dispatch(marchedGroupsX, marchedGroupsY, 1);
+
+		// trace the bounces a level at a time, each dispatch sized on the gpu by the level before it
+		vk::MemoryBarrier levelBarrier(vk::AccessFlagBits::eShaderWrite,
+			vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eIndirectCommandRead);
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, bouncePipeline);
+		for (uint32_t level = 1; level <= quality.maxBounces; ++level) {
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+				vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect, {},
+				levelBarrier, {}, {});
+			commandBuffer.pushConstants(mainPipelineLayout, vk::ShaderStageFlagBits::eCompute,
+				offsetof(PushConstants, bounceLevel), sizeof(level), &level);
+			commandBuffer.dispatchIndirect(bounceCounterBuffer,
+				offsetof(BounceCounters, levelGroups) + level * sizeof(vk::DispatchIndirectCommand));
+		}
+
+		// report how many rays were queued, so the ones past the capacity can be counted once the frame is read back
+		vk::MemoryBarrier queueCountBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer,
+			{}, queueCountBarrier, {}, {});
+		commandBuffer.copyBuffer(bounceCounterBuffer, currentFlight.statsBuffer, vk::BufferCopy(
+			offsetof(BounceCounters, allocated), offsetof(MarchStats, bouncesQueued), sizeof(uint32_t)));
+		vk::MemoryBarrier statsReadBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+			{}, statsReadBarrier, {}, {});
+
+		// blend the traced bounces into the marched pixels
+		vk::MemoryBarrier bounceBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eComputeShader, {}, bounceBarrier, {}, {});
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, compositePipeline);
+		commandBuffer.dispatch(marchedGroupsX, marchedGroupsY, 1);
+
+		if (bounceScale != 1) {
+			// spread the reduced resolution bounces over the pixels that didn't trace their own
+			vk::MemoryBarrier compositeBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+				vk::PipelineStageFlagBits::eComputeShader, {}, compositeBarrier, {}, {});
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, upsamplePipeline);
+			commandBuffer.dispatch(marchedGroupsX, marchedGroupsY, 1);
+		}
+
+		if (interleave != 1) {
+			// reconstruct the skipped pixels from their marched neighbours and last frame
+			vk::MemoryBarrier marchBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+				vk::PipelineStageFlagBits::eComputeShader, {}, marchBarrier, {}, {});
+
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, resolvePipeline);
+			commandBuffer.dispatch((renderExtent.width + MARCH_TILE_SIZE - 1) / MARCH_TILE_SIZE,
+				(renderExtent.height + MARCH_TILE_SIZE - 1) / MARCH_TILE_SIZE, 1);
+		}
+		presentTraceTarget(commandBuffer, imageIndex, direct, vk::PipelineStageFlagBits::eComputeShader);
 
 		// begin render pass
 		commandBuffer.beginRenderPass(renderBeginInfo, vk::SubpassContents::eInline); // cmd: begin render pass
@@ -137,21 +521,27 @@ void Primrose::recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t ima
 		commandBuffer.setScissor(0, 1, &scissor);
 
 		// uniforms
-		std::array<vk::WriteDescriptorSet, 2> descriptorWrites = {
+		std::array<vk::WriteDescriptorSet, 3> descriptorWrites = {
 			vk::WriteDescriptorSet(VK_NULL_HANDLE, 0, 0, 1, vk::DescriptorType::eUniformBuffer),
-			vk::WriteDescriptorSet(VK_NULL_HANDLE, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler)
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 20, 0, 1, vk::DescriptorType::eCombinedImageSampler)
 		};
 		vk::DescriptorBufferInfo ubInfo = vk::DescriptorBufferInfo(currentFlight.uniformBuffer, 0, sizeof(MarchUniforms));
 		descriptorWrites[0].pBufferInfo = &ubInfo;
 		vk::DescriptorImageInfo imgInfo = vk::DescriptorImageInfo(marchSampler, marchImageView,
 			vk::ImageLayout::eShaderReadOnlyOptimal);
 		descriptorWrites[1].pImageInfo = &imgInfo;
+		vk::DescriptorImageInfo noiseInfo = vk::DescriptorImageInfo(noiseSampler, noiseVolumeView,
+			vk::ImageLayout::eShaderReadOnlyOptimal);
+		descriptorWrites[2].pImageInfo = &noiseInfo;
 
 		commandBuffer.pushDescriptorSetKHR(vk::PipelineBindPoint::eGraphics, mainPipelineLayout, 0, descriptorWrites);
 
 		// push constants
 		PushConstants push{};
 		push.time = glfwGetTime();
+		push.extent = glm::uvec2(swapchainExtent.width, swapchainExtent.height);
+		push.frameIndex = frameIndex;
 		commandBuffer.pushConstants(mainPipelineLayout, vk::ShaderStageFlagBits::eFragment, 0,
 			sizeof(PushConstants), &push); // cmd: set push constants
 
@@ -191,11 +581,108 @@ void Primrose::recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t ima
 
 	commandBuffer.endRenderPass(); // cmd: end render
 
+	if (timestampPeriod != 0.f) {
+		commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, currentFlight.timestampPool, 1);
+		currentFlight.timestampsWritten = true;
+	}
+
 	commandBuffer.end();
 }
 
 void Primrose::updateUniforms(FrameInFlight& frame) {
 	writeToDevice(frame.uniformBufferMemory, &uniforms, sizeof(uniforms));
+
+	// the next frame reprojects from this one
+	uniforms.prevCamPos = uniforms.camPos;
+	uniforms.prevCamDir = uniforms.camDir;
+	uniforms.prevCamUp = uniforms.camUp;
+}
+
+void Primrose::bakeBricks(vk::CommandBuffer cmd, FrameInFlight& currentFlight) {
+	bricksBaked = true;
+	if (!computeMarch || staticSubtrees.empty()) return; // the other backends evaluate the subtrees directly
+
+	log(fmt::format("Baking {} static subtrees", staticSubtrees.size()));
+
+	// each subtree is baked from its own program, sharing the scene's primitives and transforms, the programs
+	// are in this frame in flight's part of the buffer since its fence has been waited on
+	vk::DeviceSize programOffset = (&currentFlight - framesInFlight.data()) * MAX_BRICK_VOLUMES * brickProgramStride;
+	BrickCacheHeader header{};
+	header.capacity = BRICK_ATLAS_BRICKS * BRICK_ATLAS_BRICKS * BRICK_ATLAS_BRICKS;
+	auto program = std::make_unique<MarchUniforms>(uniforms);
+	for (size_t i = 0; i < staticSubtrees.size(); ++i) {
+		const auto& ops = staticSubtrees[i].operations;
+		header.volumes[i] = staticSubtrees[i].volume;
+		program->numOperations = ops.size();
+		std::copy(ops.begin(), ops.end(), program->operations);
+		writeToDevice(brickProgramBufferMemory, program.get(), sizeof(MarchUniforms),
+			programOffset + i * brickProgramStride);
+	}
+
+	// the frames before this one may still be sampling the cache
+	vk::MemoryBarrier cacheReuseBarrier(vk::AccessFlagBits::eShaderRead,
+		vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+		vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {},
+		cacheReuseBarrier, {}, {});
+
+	cmd.updateBuffer(brickCacheBuffer, 0, sizeof(BrickCacheHeader), &header);
+	vk::MemoryBarrier headerBarrier(vk::AccessFlagBits::eTransferWrite,
+		vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {},
+		headerBarrier, {}, {});
+
+	// one workgroup per cell of each volume
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, bakePipeline);
+	for (uint32_t i = 0; i < staticSubtrees.size(); ++i) {
+		std::array<vk::WriteDescriptorSet, 4> descriptorWrites = {
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 0, 0, 1, vk::DescriptorType::eUniformBuffer),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 17, 0, 1, vk::DescriptorType::eStorageBuffer),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 18, 0, 1, vk::DescriptorType::eStorageBuffer),
+			vk::WriteDescriptorSet(VK_NULL_HANDLE, 20, 0, 1, vk::DescriptorType::eCombinedImageSampler)
+		};
+		vk::DescriptorBufferInfo programInfo = vk::DescriptorBufferInfo(brickProgramBuffer,
+			programOffset + i * brickProgramStride, sizeof(MarchUniforms));
+		descriptorWrites[0].pBufferInfo = &programInfo;
+		vk::DescriptorBufferInfo cacheInfo = vk::DescriptorBufferInfo(brickCacheBuffer, 0, VK_WHOLE_SIZE);
+		descriptorWrites[1].pBufferInfo = &cacheInfo;
+		vk::DescriptorBufferInfo sampleInfo = vk::DescriptorBufferInfo(brickSampleBuffer, 0, VK_WHOLE_SIZE);
+		descriptorWrites[2].pBufferInfo = &sampleInfo;
+		vk::DescriptorImageInfo noiseInfo = vk::DescriptorImageInfo(noiseSampler, noiseVolumeView,
+			vk::ImageLayout::eShaderReadOnlyOptimal);
+		descriptorWrites[3].pImageInfo = &noiseInfo;
+		cmd.pushDescriptorSetKHR(vk::PipelineBindPoint::eCompute, mainPipelineLayout, 0, descriptorWrites);
+
+		cmd.pushConstants(mainPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(i), &i);
+
+		glm::uvec3 dims = staticSubtrees[i].volume.dims;
+		cmd.dispatch(dims.x, dims.y, dims.z);
+	}
+
+	// copy the baked samples into the atlas, the samples are laid out in its texel order
+	vk::MemoryBarrier bakeBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {},
+		bakeBarrier, {}, {});
+	transitionImageLayout(brickAtlas, cmd,
+		vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eComputeShader,
+		vk::ImageLayout::eTransferDstOptimal, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer);
+
+	uint32_t atlasSize = BRICK_SIZE * BRICK_ATLAS_BRICKS;
+	vk::BufferImageCopy region(0, 0, 0, vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+		vk::Offset3D(0, 0, 0), vk::Extent3D(atlasSize, atlasSize, atlasSize));
+	cmd.copyBufferToImage(brickSampleBuffer, brickAtlas, vk::ImageLayout::eTransferDstOptimal, region);
+
+	transitionImageLayout(brickAtlas, cmd,
+		vk::ImageLayout::eTransferDstOptimal, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer,
+		vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead,
+		vk::PipelineStageFlagBits::eComputeShader);
+
+	// the frame's passes read the cells written by the bake
+	vk::MemoryBarrier cellBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {},
+		cellBarrier, {}, {});
+
+	historyValid = false;
 }
 
 void Primrose::drawFrame() {
@@ -212,6 +699,7 @@ void Primrose::drawFrame() {
 	if (device.waitForFences(1, &currentFlight.inFlightFence, VK_TRUE, UINT64_MAX) != vk::Result::eSuccess) {
 		throw std::runtime_error("failed to wait for fences");
 	}
+	releaseRetiredSwapchains();
 
 	auto res = device.acquireNextImageKHR(swapchain, UINT64_MAX,
 		currentFlight.imageAvailableSemaphore, VK_NULL_HANDLE);
@@ -225,7 +713,10 @@ void Primrose::drawFrame() {
 	}
 	uint32_t imageIndex = res.value;
 
+	updateClipmap(); // the uniforms hold the new origins
 	updateUniforms(currentFlight);
+	updateRenderScale(currentFlight);
+	readMarchStats(currentFlight);
 
 	vkResetCommandBuffer(currentFlight.commandBuffer, 0);
 	recordCommandBuffer(currentFlight.commandBuffer, imageIndex, currentFlight);
@@ -234,6 +725,9 @@ void Primrose::drawFrame() {
 
 	// once the gpu reaches the color attachment stage, wait until the image is actually available
 	vk::PipelineStageFlags flag = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+	if (rayAcceleration || computeMarch) {
+		flag = vk::PipelineStageFlagBits::eAllCommands; // swap image is written by a shader or blit before the render pass
+	}
 	submitInfo.pWaitDstStageMask = &flag;
 	submitInfo.waitSemaphoreCount = 1;
 	submitInfo.pWaitSemaphores = &currentFlight.imageAvailableSemaphore;
@@ -264,6 +758,8 @@ void Primrose::drawFrame() {
 		error("Failed to present swapchain image");
 	}
 
+	frameIndex += 1;
+
 	// go to next frame in flight
 	flightIndex += 1;
 	flightIndex %= MAX_FRAMES_IN_FLIGHT; // loop after end of indexing
@@ -5,8 +5,10 @@
 #include "engine/runtime.hpp"
 #include "engine/pipeline_accelerated.hpp"
 #include "engine/pipeline_raster.hpp"
+#include "engine/pipeline_compute.hpp"
 #include "embed/ui_vert_spv.h"
 #include "embed/ui_frag_spv.h"
+#include "embed/blue_noise_rgba.h"
 
 #include <vulkan/vulkan.hpp>
 #include <GLFW/glfw3.h>
@@ -19,7 +21,11 @@
 #include <vector>
 #include <optional>
 #include <set>
+#include <map>
+#include <unordered_map>
 #include <cstring>
+#include <memory>
+#include <algorithm>
 
 namespace Primrose {
 	vk::Instance instance; // used as global vulkan state
@@ -27,15 +33,23 @@ namespace Primrose {
 	vk::Device device; // logical connection to the physical device
 
 	vk::RenderPass renderPass; // render pass with commands used to render a frame
+	vk::PipelineCache pipelineCache;
 
 	bool rayAcceleration; // set by pickPhysicalDevice
+	bool computeMarch; // set by pickPhysicalDevice
 
 	vk::AccelerationStructureKHR topStructure;
 	vk::Buffer topStructureBuffer;
 	vk::DeviceMemory topStructureMemory;
-	vk::AccelerationStructureKHR aabbStructure;
-	vk::Buffer aabbStructureBuffer;
-	vk::DeviceMemory aabbStructureMemory;
+	std::vector<BottomStructure> bottomStructures;
+	vk::Buffer attributeBuffer;
+	vk::DeviceMemory attributeMemory;
+	vk::Buffer instanceBuffer;
+	vk::DeviceMemory instanceMemory;
+	size_t instanceCapacity = 0;
+	vk::Buffer structureScratchBuffer;
+	vk::DeviceMemory structureScratchMemory;
+	vk::DeviceSize structureScratchCapacity = 0;
 
 	vk::Buffer rayShaderTable;
 	vk::DeviceMemory rayShaderTableMemory;
@@ -44,13 +58,63 @@ namespace Primrose {
 	vk::StridedDeviceAddressRegionKHR missGroupAddress;
 	vk::StridedDeviceAddressRegionKHR callableGroupAddress;
 
+	bool mutableSwapchain = false; // set by createLogicalDevice
+	bool traceDirect = false; // set by createSwapchain
+	bool traceSrgbEncode = false; // set by createSwapchain
 	vk::Image traceImage;
 	vk::ImageView traceImageView;
 	vk::DeviceMemory traceImageMemory;
+	vk::Extent2D renderExtent; // set every frame by the render scale controller
+	float timestampPeriod = 0.f; // set by pickPhysicalDevice
+	bool traceBlit = false; // set by createTraceImage
+	vk::Extent2D storageExtent; // set by chooseStorageExtent
+
+	std::array<StorageImage, 2> historyColorImages;
+	std::array<StorageImage, 2> historyDepthImages;
+	StorageImage motionImage;
+	StorageImage surfaceImage;
+	StorageImage coneImage;
+	StorageImage bounceHeadImage;
+	StorageImage bounceCountImage;
+	StorageImage bounceImage;
+	vk::Buffer bounceRayBuffer;
+	vk::DeviceMemory bounceRayBufferMemory;
+	vk::Buffer bounceCounterBuffer;
+	vk::DeviceMemory bounceCounterBufferMemory;
+	uint32_t bounceCapacity = 0; // set by createBounceQueue
+
+	vk::Image brickAtlas;
+	vk::DeviceMemory brickAtlasMemory;
+	vk::ImageView brickAtlasView;
+	vk::Sampler brickSampler;
+	vk::Buffer brickCacheBuffer;
+	vk::DeviceMemory brickCacheBufferMemory;
+	vk::Buffer brickSampleBuffer;
+	vk::DeviceMemory brickSampleBufferMemory;
+	vk::Buffer brickProgramBuffer;
+	vk::DeviceMemory brickProgramBufferMemory;
+	vk::DeviceSize brickProgramStride = 0; // set by createBrickCache
+
+	vk::Image noiseVolume;
+	vk::DeviceMemory noiseVolumeMemory;
+	vk::ImageView noiseVolumeView;
+	vk::Sampler noiseSampler;
+
+	vk::Image clipmap;
+	vk::DeviceMemory clipmapMemory;
+	vk::ImageView clipmapView;
 
 	vk::DescriptorSetLayout mainDescriptorLayout;
 	vk::PipelineLayout mainPipelineLayout;
 	vk::Pipeline mainPipeline;
+	vk::Pipeline resolvePipeline;
+	vk::Pipeline conePipeline;
+	vk::Pipeline shadePipeline;
+	vk::Pipeline bouncePipeline;
+	vk::Pipeline compositePipeline;
+	vk::Pipeline upsamplePipeline;
+	vk::Pipeline bakePipeline;
+	vk::Pipeline clipmapPipeline;
 
 	vk::DescriptorSetLayout uiDescriptorLayout;
 	vk::PipelineLayout uiPipelineLayout;
@@ -62,6 +126,7 @@ namespace Primrose {
 	vk::SwapchainKHR swapchain; // chain of images queued to be presented to display
 	std::vector<SwapchainFrame> swapchainFrames;
 	vk::Format swapchainImageFormat; // pixel format used in swapchain
+	vk::Format swapchainStorageFormat; // format of SwapchainFrame::storageView, when tracing directly
 	vk::Extent2D swapchainExtent; // resolution of swapchain
 
 	int windowWidth = 0;
@@ -87,6 +152,32 @@ namespace Primrose {
 	void(*renderPassCallback)(vk::CommandBuffer& cmd) = nullptr;
 	void(*scrollCallback)(float scroll) = nullptr;
 
+	// swapchain resources replaced by recreateSwapchain, destroyed once no frame in flight uses them
+	namespace {
+		struct RetiredSwapchain {
+			unsigned int frame; // frameIndex when it was replaced
+			vk::SwapchainKHR swapchain;
+			std::vector<SwapchainFrame> frames;
+			std::vector<StorageImage> images; // only when the new swapchain outgrew them
+			std::vector<std::pair<vk::Buffer, vk::DeviceMemory>> buffers; // likewise
+		};
+		std::vector<RetiredSwapchain> retiredSwapchains;
+
+		void destroyRetiredSwapchain(RetiredSwapchain& old) {
+			for (auto& image : old.images) destroyStorageImage(image);
+			for (const auto& [buffer, memory] : old.buffers) {
+				device.destroyBuffer(buffer);
+				device.freeMemory(memory);
+			}
+			for (const auto& frame : old.frames) {
+				device.destroyFramebuffer(frame.framebuffer);
+				device.destroyImageView(frame.imageView);
+				device.destroyImageView(frame.storageView);
+			}
+			device.destroySwapchainKHR(old.swapchain);
+		}
+	}
+
 	// glfw callbacks
 	namespace {
 		void windowResizedCallback(GLFWwindow*, int, int) {
@@ -236,6 +327,9 @@ namespace Primrose {
 			vk::PhysicalDeviceFeatures supportedFeatures = phyDevice.getFeatures();
 			if (supportedFeatures.samplerAnisotropy == VK_FALSE) return false;
 
+			// trace shaders write to images of any format (swapchain or trace image)
+			if (supportedFeatures.shaderStorageImageWriteWithoutFormat == VK_FALSE) *supportsRayAcc = false;
+
 			// device is suitable for app
 			return true;
 		}
@@ -310,6 +404,12 @@ void Primrose::writeToDevice(vk::DeviceMemory memory, const void* data, size_t s
 	device.unmapMemory(memory);
 }
 
+void Primrose::readFromDevice(vk::DeviceMemory memory, void* data, size_t size, size_t offset) {
+	void* src = device.mapMemory(memory, offset, size);
+	memcpy(data, src, size);
+	device.unmapMemory(memory);
+}
+
 vk::CommandBuffer Primrose::startSingleTimeCommandBuffer() {
 	vk::CommandBufferAllocateInfo allocInfo{};
 	allocInfo.level = vk::CommandBufferLevel::ePrimary;
@@ -402,7 +502,8 @@ void Primrose::importTexture(const char* path, vk::Image* image, vk::DeviceMemor
 	stbi_image_free(data);
 }
 
-void Primrose::imageFromData(void* data, uint32_t width, uint32_t height, vk::Image* image, vk::DeviceMemory* imageMemory) {
+void Primrose::imageFromData(void* data, uint32_t width, uint32_t height, vk::Image* image, vk::DeviceMemory* imageMemory,
+	vk::Format format) {
 	vk::DeviceSize dataSize = width * height * 4;
 
 	// create and write to staging buffer
@@ -419,7 +520,7 @@ void Primrose::imageFromData(void* data, uint32_t width, uint32_t height, vk::Im
 	imageInfo.extent = vk::Extent3D(width, height, 1); // depth=1 for 2d image
 	imageInfo.mipLevels = 1; // no mipmapping
 	imageInfo.arrayLayers = 1; // not a layered image
-	imageInfo.format = vk::Format::eR8G8B8A8Srgb;
+	imageInfo.format = format;
 	imageInfo.tiling = vk::ImageTiling::eOptimal;
 	imageInfo.initialLayout = vk::ImageLayout::eUndefined;
 	imageInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
@@ -459,7 +560,37 @@ void Primrose::imageFromData(void* data, uint32_t width, uint32_t height, vk::Im
 	device.freeMemory(stagingBufferMemory);
 }
 
-vk::ImageView Primrose::createImageView(vk::Image image, vk::Format format) {
+void Primrose::createStorageImage(vk::Format format, vk::Extent2D extent, StorageImage* image) {
+	vk::ImageCreateInfo imgInfo{};
+	imgInfo.imageType = vk::ImageType::e2D;
+	imgInfo.extent = vk::Extent3D(extent, 1);
+	imgInfo.mipLevels = 1;
+	imgInfo.arrayLayers = 1;
+	imgInfo.format = format;
+	imgInfo.tiling = vk::ImageTiling::eOptimal;
+	imgInfo.initialLayout = vk::ImageLayout::eUndefined;
+	imgInfo.usage = vk::ImageUsageFlagBits::eStorage;
+	imgInfo.sharingMode = vk::SharingMode::eExclusive;
+	imgInfo.samples = vk::SampleCountFlagBits::e1;
+
+	image->image = device.createImage(imgInfo);
+
+	vk::MemoryRequirements memReqs = device.getImageMemoryRequirements(image->image);
+	createDeviceMemory(memReqs, vk::MemoryPropertyFlagBits::eDeviceLocal, &image->memory);
+	device.bindImageMemory(image->image, image->memory, 0);
+
+	image->view = createImageView(image->image, format);
+
+	transitionImageLayout(image->image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+}
+
+void Primrose::destroyStorageImage(StorageImage& image) {
+	device.destroyImageView(image.view);
+	device.freeMemory(image.memory);
+	device.destroyImage(image.image);
+}
+
+vk::ImageView Primrose::createImageView(vk::Image image, vk::Format format, vk::ImageUsageFlags usage) {
 	vk::ImageViewCreateInfo viewInfo{};
 	viewInfo.image = image;
 	viewInfo.viewType = vk::ImageViewType::e2D;
@@ -470,6 +601,10 @@ vk::ImageView Primrose::createImageView(vk::Image image, vk::Format format) {
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
+	// narrows the image's usage, for views whose format doesn't support all of it
+	vk::ImageViewUsageCreateInfo usageInfo(usage);
+	if (usage) viewInfo.pNext = &usageInfo;
+
 	return device.createImageView(viewInfo);
 }
 
@@ -481,8 +616,101 @@ vk::ShaderModule Primrose::createShaderModule(const uint32_t* code, size_t lengt
 	return device.createShaderModule(info); // TODO just inline everywhere
 }
 
-vk::ShaderModule Primrose::compileShaderModule(const char* code) {
+namespace {
+	// resolves #include directives against in-memory sources by file name, ignoring the directory
+	class SourceIncluder : public shaderc::CompileOptions::IncluderInterface {
+	public:
+		explicit SourceIncluder(const std::map<std::string, std::string>& sources) : sources(sources) {}
+
+		shaderc_include_result* GetInclude(const char* requestedSource, shaderc_include_type type,
+			const char* requestingSource, size_t includeDepth) override {
+
+			std::string name = requestedSource;
+			name = name.substr(name.find_last_of('/') + 1);
+
+			auto* result = results.emplace_back(std::make_unique<shaderc_include_result>()).get();
+			if (sources.contains(name)) {
+				auto* source = &sources.find(name)->second;
+				result->source_name = requestedSource;
+				result->source_name_length = std::strlen(requestedSource);
+				result->content = source->data();
+				result->content_length = source->size();
+			} else {
+				// an empty source name tells shaderc the include failed, content holds the error
+				result->content = "include not found";
+				result->content_length = std::strlen(result->content);
+			}
+			return result;
+		}
+
+		void ReleaseInclude(shaderc_include_result* data) override {
+			std::erase_if(results, [&](const auto& result) { return result.get() == data; });
+		}
+
+	private:
+		const std::map<std::string, std::string>& sources;
+		std::vector<std::unique_ptr<shaderc_include_result>> results; // owned until shaderc releases them
+	};
 
+	struct CompiledShader {
+		std::vector<uint32_t> spirv;
+		bool used = true; // returned by compileShaderModule since the last trimShaderCache
+	};
+	std::unordered_map<std::string, CompiledShader> compiledShaders; // keyed by the stage and every source
+}
+
+vk::ShaderModule Primrose::compileShaderModule(const std::string& code, vk::ShaderStageFlagBits stage,
+	const std::map<std::string, std::string>& includes) {
+
+	// key on everything the spir-v depends on, so an unchanged shader isn't compiled twice
+	std::string key = fmt::format("{}", static_cast<uint32_t>(stage));
+	key.push_back('\0');
+	key += code;
+	for (const auto& [name, source] : includes) {
+		key.push_back('\0');
+		key += name;
+		key.push_back('\0');
+		key += source;
+	}
+
+	auto it = compiledShaders.find(key);
+	if (it == compiledShaders.end()) {
+		shaderc_shader_kind kind;
+		switch (stage) {
+			case vk::ShaderStageFlagBits::eVertex: kind = shaderc_vertex_shader; break;
+			case vk::ShaderStageFlagBits::eFragment: kind = shaderc_fragment_shader; break;
+			case vk::ShaderStageFlagBits::eCompute: kind = shaderc_compute_shader; break;
+			case vk::ShaderStageFlagBits::eRaygenKHR: kind = shaderc_raygen_shader; break;
+			case vk::ShaderStageFlagBits::eAnyHitKHR: kind = shaderc_anyhit_shader; break;
+			case vk::ShaderStageFlagBits::eClosestHitKHR: kind = shaderc_closesthit_shader; break;
+			case vk::ShaderStageFlagBits::eMissKHR: kind = shaderc_miss_shader; break;
+			case vk::ShaderStageFlagBits::eIntersectionKHR: kind = shaderc_intersection_shader; break;
+			default: throw std::runtime_error("shader stage can't be compiled at runtime");
+		}
+
+		shaderc::CompileOptions options;
+		options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+		options.SetOptimizationLevel(shaderc_optimization_level_performance);
+		options.SetIncluder(std::make_unique<SourceIncluder>(includes));
+
+		shaderc::Compiler compiler;
+		shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(code, kind, "runtime shader", options);
+		if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+			throw std::runtime_error(fmt::format("failed to compile shader: {}", result.GetErrorMessage()));
+		}
+
+		it = compiledShaders.emplace(std::move(key),
+			CompiledShader{std::vector<uint32_t>(result.cbegin(), result.cend())}).first;
+	}
+
+	it->second.used = true;
+	const std::vector<uint32_t>& spirv = it->second.spirv;
+	return createShaderModule(spirv.data(), spirv.size() * sizeof(uint32_t));
+}
+
+void Primrose::trimShaderCache() {
+	std::erase_if(compiledShaders, [](const auto& entry) { return !entry.second.used; });
+	for (auto& [key, shader] : compiledShaders) shader.used = false;
 }
 
 
@@ -499,6 +727,7 @@ void Primrose::setup(const char* applicationName, unsigned int applicationVersio
 	// TODO put screenHeight definition in swapchainExtent setter
 	setFov(Settings::fov); // initial set fov
 	setZoom(1.f); // initial set zoom
+	setRelaxation(Settings::relaxation);
 	uniforms.screenHeight = static_cast<float>(swapchainExtent.height) / static_cast<float>(swapchainExtent.width);
 	//Runtime::uniforms.primitives = Scene::primitives.data();
 
@@ -568,14 +797,28 @@ void Primrose::initVulkan() {
 	createLogicalDevice();
 
 	createCommandPool();
+	createPipelineCache();
 
 	createSwapchain();
 	createRenderPass();
 	createSwapchainFrames();
-	if (rayAcceleration) createTraceImage();
+	chooseStorageExtent();
+	if (rayAcceleration || computeMarch) createTraceImage();
+	if (computeMarch) {
+		createHistoryImages();
+		createConeImage();
+		createBounceQueue();
+		createBrickCache();
+		createClipmap();
+	}
+	createNoiseVolume(); // sampled by the procedural primitives of every backend
 
+	quality = QualitySettings::preset(Settings::qualityPreset);
 	if (rayAcceleration) {
 		createAcceleratedPipelineLayout();
+	} else if (computeMarch) {
+		createComputePipelineLayout();
+		createComputePipeline();
 	} else {
 		createRasterPipelineLayout();
 		createRasterPipeline();
@@ -744,6 +987,17 @@ void Primrose::pickPhysicalDevice() {
 	log(fmt::format("Choosing physical device with {} and {} mb VRAM",
 		rayAcceleration ? "ray tracing support" : "no ray tracing support",
 		getPhysicalDeviceVramMb(physicalDevice)));
+
+	// the compute shader writes to images of any format, same as the trace shaders, and to rg16f motion vectors
+	vk::PhysicalDeviceFeatures supportedFeatures = physicalDevice.getFeatures();
+	computeMarch = !rayAcceleration && Settings::preferComputeMarch
+		&& supportedFeatures.shaderStorageImageWriteWithoutFormat
+		&& supportedFeatures.shaderStorageImageExtendedFormats;
+	if (!rayAcceleration) verbose(fmt::format("Marching in {} shader", computeMarch ? "compute" : "fragment"));
+
+	// gpu frame times drive the dynamic resolution controller
+	vk::PhysicalDeviceLimits limits = physicalDevice.getProperties().limits;
+	timestampPeriod = limits.timestampComputeAndGraphics ? limits.timestampPeriod : 0.f;
 }
 
 void Primrose::createLogicalDevice() {
@@ -765,11 +1019,25 @@ void Primrose::createLogicalDevice() {
 
 	vk::PhysicalDeviceFeatures features{};
 	features.samplerAnisotropy = VK_TRUE;
+	features.shaderStorageImageWriteWithoutFormat = rayAcceleration || computeMarch;
+	features.shaderStorageImageExtendedFormats = computeMarch;
 
 	std::vector<const char*> extensions;
 	extensions.insert(extensions.end(), REQUIRED_EXTENSIONS.begin(), REQUIRED_EXTENSIONS.end());
 	if (rayAcceleration) extensions.insert(extensions.end(), RAY_EXTENSIONS.begin(), RAY_EXTENSIONS.end()); // TODO remove ||true
 
+	// lets srgb swapchain images also be written as unorm storage images by the trace shaders
+	mutableSwapchain = false;
+	if ((rayAcceleration || computeMarch) && Settings::traceToSwapchain) {
+		for (const auto& available : physicalDevice.enumerateDeviceExtensionProperties()) {
+			if (strcmp(available.extensionName, VK_KHR_SWAPCHAIN_MUTABLE_FORMAT_EXTENSION_NAME) == 0) {
+				extensions.push_back(VK_KHR_SWAPCHAIN_MUTABLE_FORMAT_EXTENSION_NAME);
+				mutableSwapchain = true;
+				break;
+			}
+		}
+	}
+
 	vk::DeviceCreateInfo createInfo{};
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size()); // create queues
 	createInfo.pQueueCreateInfos = queueInfos.data();
@@ -819,6 +1087,45 @@ void Primrose::createSwapchain() {
 	verbose(fmt::format("Swapchain format: {}, {} {}", to_string(surfaceFormat.format),
 		to_string(surfaceFormat.colorSpace), ideal ? "(ideal)" : "(not ideal)"));
 
+	// if tracing rays, trace straight into the swapchain when its format can be written by the trace shader,
+	// the format is kept since the ui pass also draws to it, otherwise the trace image is blitted instead
+	// srgb formats are practically never storage capable, so with VK_KHR_swapchain_mutable_format the images
+	// are also created viewable as their unorm counterpart, which the trace shaders write through
+	traceDirect = false;
+	traceSrgbEncode = false;
+	bool mutableFormat = false;
+	swapchainStorageFormat = surfaceFormat.format;
+	if ((rayAcceleration || computeMarch) && Settings::traceToSwapchain
+		&& (swapCapabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eStorage)) {
+
+		vk::Format unorm = surfaceFormat.format == vk::Format::eB8G8R8A8Srgb ? vk::Format::eB8G8R8A8Unorm
+			: surfaceFormat.format == vk::Format::eR8G8B8A8Srgb ? vk::Format::eR8G8B8A8Unorm
+			: surfaceFormat.format == vk::Format::eA8B8G8R8SrgbPack32 ? vk::Format::eA8B8G8R8UnormPack32
+			: vk::Format::eUndefined;
+		auto canStore = [](vk::Format format) {
+			return static_cast<bool>(physicalDevice.getFormatProperties(format).optimalTilingFeatures
+				& vk::FormatFeatureFlagBits::eStorageImage);
+		};
+
+		if (canStore(surfaceFormat.format)) {
+			traceDirect = true;
+		} else if (mutableSwapchain && unorm != vk::Format::eUndefined && canStore(unorm)) {
+			swapchainStorageFormat = unorm;
+			mutableFormat = true;
+			traceDirect = true;
+		}
+
+		// a unorm format presented as srgb needs the shader to encode srgb itself
+		traceSrgbEncode = traceDirect && surfaceFormat.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear
+			&& (swapchainStorageFormat == vk::Format::eB8G8R8A8Unorm
+				|| swapchainStorageFormat == vk::Format::eR8G8B8A8Unorm
+				|| swapchainStorageFormat == vk::Format::eA8B8G8R8UnormPack32);
+	}
+	if (rayAcceleration || computeMarch) {
+		verbose(fmt::format("Tracing {}", !traceDirect ? "to trace image"
+			: mutableFormat ? "directly to swapchain through a unorm view" : "directly to swapchain"));
+	}
+
 	swapchainImageFormat = surfaceFormat.format; // save format to global var
 
 	// choose presentation mode
@@ -868,7 +1175,16 @@ void Primrose::createSwapchain() {
 	createInfo.imageUsage = vk::ImageUsageFlagBits::eColorAttachment; // what we're using the images for
 	createInfo.presentMode = presentMode;
 
-	if (rayAcceleration) createInfo.imageUsage |= vk::ImageUsageFlagBits::eTransferDst;
+	if (traceDirect) createInfo.imageUsage |= vk::ImageUsageFlagBits::eStorage; // written by trace shader
+
+	std::array<vk::Format, 2> viewFormats = { surfaceFormat.format, swapchainStorageFormat };
+	vk::ImageFormatListCreateInfo formatList(viewFormats);
+	if (mutableFormat) {
+		createInfo.flags = vk::SwapchainCreateFlagBitsKHR::eMutableFormat;
+		createInfo.pNext = &formatList;
+	}
+	if (rayAcceleration || computeMarch) createInfo.imageUsage |= vk::ImageUsageFlagBits::eTransferDst;
+	// ^ blit from trace image, when marching below full resolution or without storage support
 
 	QueueFamilyIndices indices = getQueueFamilies(physicalDevice);
 	uint32_t familyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
@@ -889,7 +1205,7 @@ void Primrose::createSwapchain() {
 	createInfo.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque; // alpha bit is ignored by compositor
 	createInfo.clipped = VK_TRUE; // cull pixels that are covered by other windows
 
-	createInfo.oldSwapchain = VK_NULL_HANDLE; // handle for last swapchain
+	createInfo.oldSwapchain = swapchain; // last swapchain when recreating, lets the driver hand over its images
 
 	swapchain = device.createSwapchainKHR(createInfo);
 
@@ -911,7 +1227,7 @@ void Primrose::createRenderPass() {
 	colorAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
 	colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
 
-	if (rayAcceleration) {
+	if (rayAcceleration || computeMarch) {
 		colorAttachment.initialLayout = vk::ImageLayout::ePresentSrcKHR; // keep same layout between frames
 		// TODO ^ see if this or (loadOp = eLoad) affects performance, if so find a way to trace rays inside the render pass
 	} else {
@@ -956,6 +1272,7 @@ void Primrose::createSwapchainFrames() {
 
 	// fetch images from swapchain
 	std::vector<vk::Image> images = device.getSwapchainImagesKHR(swapchain);
+	swapchainFrames.clear();
 	swapchainFrames.resize(images.size());
 
 	// framebuffer settings
@@ -969,8 +1286,14 @@ void Primrose::createSwapchainFrames() {
 		// image
 		swapchainFrames[i].image = images[i];
 
-		// image view
-		swapchainFrames[i].imageView = createImageView(swapchainFrames[i].image, swapchainImageFormat);
+		// image view, an srgb view of mutable images is only drawn to since its format can't be stored to
+		swapchainFrames[i].imageView = createImageView(swapchainFrames[i].image, swapchainImageFormat,
+			swapchainStorageFormat == swapchainImageFormat ? vk::ImageUsageFlags()
+				: vk::ImageUsageFlagBits::eColorAttachment);
+		if (traceDirect) {
+			swapchainFrames[i].storageView = createImageView(swapchainFrames[i].image, swapchainStorageFormat,
+				vk::ImageUsageFlagBits::eStorage);
+		}
 
 		// framebuffer
 		framebufferInfo.attachmentCount = 1;
@@ -980,27 +1303,37 @@ void Primrose::createSwapchainFrames() {
 	}
 }
 
+void Primrose::chooseStorageExtent() {
+	// a quarter of headroom in each direction, so dragging the window larger rarely reallocates storage images
+	uint32_t maxSize = physicalDevice.getProperties().limits.maxImageDimension2D;
+	auto padded = [maxSize](uint32_t size) {
+		return std::min((size + size / 4 + MARCH_TILE_SIZE - 1) / MARCH_TILE_SIZE * MARCH_TILE_SIZE, maxSize);
+	};
+	storageExtent = vk::Extent2D(padded(swapchainExtent.width), padded(swapchainExtent.height));
+}
+
 void Primrose::createTraceImage() {
 	log("Creating trace image");
 
-	vk::Format storageFormat = vk::Format::eUndefined;
-	std::vector<vk::SurfaceFormatKHR> formats = physicalDevice.getSurfaceFormatsKHR(surface);
-	for (vk::SurfaceFormatKHR f : formats) {
-		vk::FormatProperties p = physicalDevice.getFormatProperties(f.format);
-		if (p.optimalTilingFeatures | vk::FormatFeatureFlagBits::eStorageImage) {
-			storageFormat = f.format;
-			break;
-		}
-	}
-	if (storageFormat == vk::Format::eUndefined) {
-		error("No surface format supports StorageImage bit");
+	// half floats keep the trace image at 8 bytes per pixel, the blit converts to the swapchain format
+	// the image is storageExtent sized, only its top left renderExtent corner is marched into
+	vk::Format storageFormat = vk::Format::eR16G16B16A16Sfloat;
+	vk::FormatProperties p = physicalDevice.getFormatProperties(storageFormat);
+	traceBlit = (p.optimalTilingFeatures & vk::FormatFeatureFlagBits::eStorageImage)
+		&& (p.optimalTilingFeatures & vk::FormatFeatureFlagBits::eBlitSrc)
+		&& (physicalDevice.getFormatProperties(swapchainImageFormat).optimalTilingFeatures
+			& vk::FormatFeatureFlagBits::eBlitDst);
+	if (!traceBlit) {
+		if (!traceDirect) error("Trace image and swapchain formats do not support blitting");
+		warning("Trace image cannot be blitted to the swapchain, rendering at full resolution");
+		return;
 	}
 
 	// trace image
 	vk::ImageCreateInfo imgInfo{};
 
 	imgInfo.imageType = vk::ImageType::e2D;
-	imgInfo.extent = vk::Extent3D(swapchainExtent, 1);
+	imgInfo.extent = vk::Extent3D(storageExtent, 1);
 	imgInfo.mipLevels = 1;
 	imgInfo.arrayLayers = 1;
 	imgInfo.format = storageFormat;
@@ -1025,6 +1358,291 @@ void Primrose::createTraceImage() {
 	transitionImageLayout(traceImage, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
 }
 
+void Primrose::createHistoryImages() {
+	log("Creating history images");
+
+	// sized like the trace image, only the top left renderExtent corner is used
+	for (auto& image : historyColorImages) createStorageImage(vk::Format::eR16G16B16A16Sfloat, storageExtent, &image);
+	for (auto& image : historyDepthImages) createStorageImage(vk::Format::eR32Sfloat, storageExtent, &image);
+	createStorageImage(vk::Format::eR16G16Sfloat, storageExtent, &motionImage);
+	createStorageImage(vk::Format::eR32G32Uint, storageExtent, &surfaceImage);
+
+	historyValid = false;
+	historyExtent = vk::Extent2D();
+}
+
+void Primrose::createConeImage() {
+	log("Creating cone image");
+
+	vk::Extent2D cells((storageExtent.width + CONE_CELL_SIZE - 1) / CONE_CELL_SIZE,
+		(storageExtent.height + CONE_CELL_SIZE - 1) / CONE_CELL_SIZE);
+	createStorageImage(vk::Format::eR32Sfloat, cells, &coneImage);
+}
+
+void Primrose::createBounceQueue() {
+	log("Creating bounce queue");
+
+	// per pixel lists, sized like the history images
+	createStorageImage(vk::Format::eR32Uint, storageExtent, &bounceHeadImage);
+	createStorageImage(vk::Format::eR32Uint, storageExtent, &bounceCountImage);
+	createStorageImage(vk::Format::eR16G16B16A16Sfloat, storageExtent, &bounceImage);
+
+	// most pixels never bounce, so the queue holds a fraction of a ray per pixel rather than MAX_BOUNCES
+	bounceCapacity = std::max(1u, static_cast<uint32_t>(
+		static_cast<float>(storageExtent.width) * static_cast<float>(storageExtent.height) * Settings::bounceBudget));
+	createBuffer(static_cast<vk::DeviceSize>(bounceCapacity) * BOUNCE_RAY_SIZE, vk::BufferUsageFlagBits::eStorageBuffer,
+		vk::MemoryPropertyFlagBits::eDeviceLocal, &bounceRayBuffer, &bounceRayBufferMemory);
+
+	createBuffer(sizeof(BounceCounters), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer
+		| vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+		vk::MemoryPropertyFlagBits::eDeviceLocal, &bounceCounterBuffer, &bounceCounterBufferMemory);
+}
+
+void Primrose::createBrickCache() {
+	log("Creating brick cache");
+
+	// r16f can be sampled linearly on every device but not always stored to, so bakes are copied in from a buffer
+	uint32_t atlasSize = BRICK_SIZE * BRICK_ATLAS_BRICKS;
+	vk::ImageCreateInfo imgInfo{};
+	imgInfo.imageType = vk::ImageType::e3D;
+	imgInfo.extent = vk::Extent3D(atlasSize, atlasSize, atlasSize);
+	imgInfo.mipLevels = 1;
+	imgInfo.arrayLayers = 1;
+	imgInfo.format = vk::Format::eR16Sfloat;
+	imgInfo.tiling = vk::ImageTiling::eOptimal;
+	imgInfo.initialLayout = vk::ImageLayout::eUndefined;
+	imgInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+	imgInfo.sharingMode = vk::SharingMode::eExclusive;
+	imgInfo.samples = vk::SampleCountFlagBits::e1;
+
+	brickAtlas = device.createImage(imgInfo);
+
+	vk::MemoryRequirements memReqs = device.getImageMemoryRequirements(brickAtlas);
+	createDeviceMemory(memReqs, vk::MemoryPropertyFlagBits::eDeviceLocal, &brickAtlasMemory);
+	device.bindImageMemory(brickAtlas, brickAtlasMemory, 0);
+
+	vk::ImageViewCreateInfo viewInfo({}, brickAtlas, vk::ImageViewType::e3D, vk::Format::eR16Sfloat, {},
+		vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+	brickAtlasView = device.createImageView(viewInfo);
+
+	// bound every frame, but only sampled through cells written by a bake
+	vk::CommandBuffer cmd = startSingleTimeCommandBuffer();
+	transitionImageLayout(brickAtlas, cmd,
+		vk::ImageLayout::eUndefined, vk::AccessFlagBits::eNone, vk::PipelineStageFlagBits::eTopOfPipe,
+		vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead,
+		vk::PipelineStageFlagBits::eComputeShader);
+	endSingleTimeCommandBuffer(cmd);
+
+	vk::SamplerCreateInfo samplerInfo{};
+	samplerInfo.magFilter = vk::Filter::eLinear; // trilinear between a brick's samples
+	samplerInfo.minFilter = vk::Filter::eLinear;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+	samplerInfo.mipLodBias = 0;
+	samplerInfo.minLod = 0;
+	samplerInfo.maxLod = 0;
+	brickSampler = device.createSampler(samplerInfo);
+
+	// every volume's grid is at most brickResolution cells plus padding per side
+	vk::DeviceSize maxCells = (Settings::brickResolution + 2) * (Settings::brickResolution + 2)
+		* (Settings::brickResolution + 2);
+	createBuffer(sizeof(BrickCacheHeader) + MAX_BRICK_VOLUMES * maxCells * sizeof(BrickCell),
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		vk::MemoryPropertyFlagBits::eDeviceLocal, &brickCacheBuffer, &brickCacheBufferMemory);
+
+	createBuffer(static_cast<vk::DeviceSize>(atlasSize) * atlasSize * atlasSize * sizeof(uint16_t),
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+		vk::MemoryPropertyFlagBits::eDeviceLocal, &brickSampleBuffer, &brickSampleBufferMemory);
+
+	vk::DeviceSize alignment = physicalDevice.getProperties().limits.minUniformBufferOffsetAlignment;
+	brickProgramStride = (sizeof(MarchUniforms) + alignment - 1) / alignment * alignment;
+	createBuffer(brickProgramStride * MAX_BRICK_VOLUMES * MAX_FRAMES_IN_FLIGHT, vk::BufferUsageFlagBits::eUniformBuffer,
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		&brickProgramBuffer, &brickProgramBufferMemory);
+}
+
+void Primrose::createClipmap() {
+	log("Creating clipmap");
+
+	if (Settings::clipmapLevels > MAX_CLIPMAP_LEVELS) throw std::runtime_error("too many clipmap levels");
+
+	vk::ImageCreateInfo imgInfo{};
+	imgInfo.imageType = vk::ImageType::e3D;
+	imgInfo.extent = vk::Extent3D(Settings::clipmapResolution, Settings::clipmapResolution,
+		Settings::clipmapResolution * Settings::clipmapLevels);
+	imgInfo.mipLevels = 1;
+	imgInfo.arrayLayers = 1;
+	imgInfo.format = vk::Format::eR32Sfloat;
+	imgInfo.tiling = vk::ImageTiling::eOptimal;
+	imgInfo.initialLayout = vk::ImageLayout::eUndefined;
+	imgInfo.usage = vk::ImageUsageFlagBits::eStorage;
+	imgInfo.sharingMode = vk::SharingMode::eExclusive;
+	imgInfo.samples = vk::SampleCountFlagBits::e1;
+
+	clipmap = device.createImage(imgInfo);
+
+	vk::MemoryRequirements memReqs = device.getImageMemoryRequirements(clipmap);
+	createDeviceMemory(memReqs, vk::MemoryPropertyFlagBits::eDeviceLocal, &clipmapMemory);
+	device.bindImageMemory(clipmap, clipmapMemory, 0);
+
+	vk::ImageViewCreateInfo viewInfo({}, clipmap, vk::ImageViewType::e3D, vk::Format::eR32Sfloat, {},
+		vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+	clipmapView = device.createImageView(viewInfo);
+
+	vk::CommandBuffer cmd = startSingleTimeCommandBuffer();
+	transitionImageLayout(clipmap, cmd,
+		vk::ImageLayout::eUndefined, vk::AccessFlagBits::eNone, vk::PipelineStageFlagBits::eTopOfPipe,
+		vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+		vk::PipelineStageFlagBits::eComputeShader);
+	endSingleTimeCommandBuffer(cmd);
+
+	uniforms.clipmapTexel = Settings::clipmapTexel;
+	uniforms.clipmapLevels = Settings::clipmapLevels;
+	clipmapValid = false; // filled in by the first frame
+}
+
+void Primrose::createNoiseVolume() {
+	log("Creating noise volume");
+
+	// tileable value noise, smoothstepped between random lattice values every period texels
+	auto valueNoise = [](glm::ivec3 texel, int period, uint32_t seed) {
+		int cells = static_cast<int>(NOISE_VOLUME_SIZE) / period;
+		glm::ivec3 cell = texel / period;
+		glm::vec3 f = glm::vec3(texel % period) / static_cast<float>(period);
+		f = f * f * (3.f - 2.f * f); // slope of at most 1.5 per lattice cell, noise.glsl relies on it
+
+		auto lattice = [&](glm::ivec3 offset) {
+			glm::ivec3 c = (cell + offset) % cells;
+			uint32_t h = seed;
+			for (int i = 0; i < 3; ++i) h = (h ^ static_cast<uint32_t>(c[i])) * 0x9e3779b1u + (h >> 15);
+			h ^= h >> 13;
+			h *= 0x85ebca6bu;
+			h ^= h >> 16;
+			return static_cast<float>(h & 0xffffu) / 65535.f;
+		};
+
+		float x00 = glm::mix(lattice({0, 0, 0}), lattice({1, 0, 0}), f.x);
+		float x10 = glm::mix(lattice({0, 1, 0}), lattice({1, 1, 0}), f.x);
+		float x01 = glm::mix(lattice({0, 0, 1}), lattice({1, 0, 1}), f.x);
+		float x11 = glm::mix(lattice({0, 1, 1}), lattice({1, 1, 1}), f.x);
+		return glm::mix(glm::mix(x00, x10, f.y), glm::mix(x01, x11, f.y), f.z);
+	};
+
+	// rg per texel, coarse and detail noise, followed by each mip averaged from the level before it
+	uint32_t mipLevels = static_cast<uint32_t>(std::log2(NOISE_VOLUME_SIZE)) + 1;
+	std::vector<std::vector<glm::vec2>> levels(mipLevels);
+	int size = static_cast<int>(NOISE_VOLUME_SIZE);
+	levels[0].resize(size * size * size);
+	for (int z = 0; z < size; ++z) {
+		for (int y = 0; y < size; ++y) {
+			for (int x = 0; x < size; ++x) {
+				levels[0][(z * size + y) * size + x] = glm::vec2(
+					valueNoise({x, y, z}, NOISE_COARSE_PERIOD, 1), valueNoise({x, y, z}, NOISE_DETAIL_PERIOD, 2));
+			}
+		}
+	}
+	for (uint32_t level = 1; level < mipLevels; ++level) {
+		int prevSize = size;
+		size /= 2;
+		levels[level].resize(size * size * size);
+		for (int z = 0; z < size; ++z) {
+			for (int y = 0; y < size; ++y) {
+				for (int x = 0; x < size; ++x) {
+					glm::vec2 sum(0);
+					for (int i = 0; i < 8; ++i) {
+						int px = x * 2 + (i & 1), py = y * 2 + ((i >> 1) & 1), pz = z * 2 + (i >> 2);
+						sum += levels[level - 1][(pz * prevSize + py) * prevSize + px];
+					}
+					levels[level][(z * size + y) * size + x] = sum / 8.f;
+				}
+			}
+		}
+	}
+
+	std::vector<uint8_t> data;
+	std::vector<vk::BufferImageCopy> regions;
+	size = static_cast<int>(NOISE_VOLUME_SIZE);
+	for (uint32_t level = 0; level < mipLevels; ++level, size /= 2) {
+		vk::BufferImageCopy region{};
+		region.bufferOffset = data.size();
+		region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, 0, 1);
+		region.imageExtent = vk::Extent3D(size, size, size);
+		regions.push_back(region);
+
+		for (glm::vec2 texel : levels[level]) {
+			data.push_back(static_cast<uint8_t>(std::round(texel.x * 255.f)));
+			data.push_back(static_cast<uint8_t>(std::round(texel.y * 255.f)));
+		}
+	}
+
+	vk::Buffer stagingBuffer;
+	vk::DeviceMemory stagingBufferMemory;
+	createBuffer(data.size(), vk::BufferUsageFlagBits::eTransferSrc,
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		&stagingBuffer, &stagingBufferMemory);
+	writeToDevice(stagingBufferMemory, data.data(), data.size());
+
+	vk::ImageCreateInfo imgInfo{};
+	imgInfo.imageType = vk::ImageType::e3D;
+	imgInfo.extent = vk::Extent3D(NOISE_VOLUME_SIZE, NOISE_VOLUME_SIZE, NOISE_VOLUME_SIZE);
+	imgInfo.mipLevels = mipLevels;
+	imgInfo.arrayLayers = 1;
+	imgInfo.format = vk::Format::eR8G8Unorm;
+	imgInfo.tiling = vk::ImageTiling::eOptimal;
+	imgInfo.initialLayout = vk::ImageLayout::eUndefined;
+	imgInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+	imgInfo.sharingMode = vk::SharingMode::eExclusive;
+	imgInfo.samples = vk::SampleCountFlagBits::e1;
+
+	noiseVolume = device.createImage(imgInfo);
+
+	vk::MemoryRequirements memReqs = device.getImageMemoryRequirements(noiseVolume);
+	createDeviceMemory(memReqs, vk::MemoryPropertyFlagBits::eDeviceLocal, &noiseVolumeMemory);
+	device.bindImageMemory(noiseVolume, noiseVolumeMemory, 0);
+
+	vk::ImageSubresourceRange mips(vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1);
+	vk::ImageViewCreateInfo viewInfo({}, noiseVolume, vk::ImageViewType::e3D, vk::Format::eR8G8Unorm, {}, mips);
+	noiseVolumeView = device.createImageView(viewInfo);
+
+	// transitionImageLayout only covers the first mip
+	vk::CommandBuffer cmd = startSingleTimeCommandBuffer();
+	vk::ImageMemoryBarrier barrier(vk::AccessFlagBits::eNone, vk::AccessFlagBits::eTransferWrite,
+		vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+		VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, noiseVolume, mips);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+		{}, nullptr, nullptr, barrier);
+	cmd.copyBufferToImage(stagingBuffer, noiseVolume, vk::ImageLayout::eTransferDstOptimal, regions);
+	barrier = vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead,
+		vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+		VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, noiseVolume, mips);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+		{}, nullptr, nullptr, barrier);
+	endSingleTimeCommandBuffer(cmd);
+
+	device.destroyBuffer(stagingBuffer);
+	device.freeMemory(stagingBufferMemory);
+
+	vk::SamplerCreateInfo samplerInfo{};
+	samplerInfo.magFilter = vk::Filter::eLinear; // trilinear keeps the noise's slope within its lipschitz bound
+	samplerInfo.minFilter = vk::Filter::eLinear;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+	samplerInfo.mipLodBias = 0;
+	samplerInfo.minLod = 0;
+	samplerInfo.maxLod = static_cast<float>(mipLevels - 1);
+	noiseSampler = device.createSampler(samplerInfo);
+}
+
 
 
 void Primrose::createUIPipeline() {
@@ -1061,31 +1679,23 @@ void Primrose::createUIPipeline() {
 void Primrose::createDitherTexture() {
 	log("Creating dither texture");
 
-	int texWidth = windowWidth*2;
-	int texHeight = windowHeight*2;
-	size_t dataSize = texWidth * texHeight * 4;
-
-	srand(time(nullptr));
-
-	void* randData = malloc(dataSize);
-	for (int i = 0; i < dataSize; ++i) {
-		*(static_cast<uint8_t*>(randData) + i) = rand() % 256;
+	// square tileable blue noise made by blue_noise.py, each channel is a different frame of noise
+	uint32_t texSize = static_cast<uint32_t>(std::sqrt(blueNoiseRgbaSize / 4));
+	if (texSize * texSize * 4 != blueNoiseRgbaSize) {
+		throw std::runtime_error("Blue noise texture is not square");
 	}
 
-	imageFromData(randData, texWidth, texHeight, &marchTexture, &marchTextureMemory);
-
-	free(randData);
-
-	marchImageView = createImageView(marchTexture, vk::Format::eR8G8B8A8Srgb);
+	// unorm so the noise values stay evenly distributed, srgb decoding would skew them
+	imageFromData(blueNoiseRgbaData, texSize, texSize, &marchTexture, &marchTextureMemory, vk::Format::eR8G8B8A8Unorm);
 
-	vk::PhysicalDeviceProperties deviceProperties = physicalDevice.getProperties();
+	marchImageView = createImageView(marchTexture, vk::Format::eR8G8B8A8Unorm);
 
 	vk::SamplerCreateInfo samplerInfo{};
-	samplerInfo.magFilter = vk::Filter::eNearest; // when magnified, ie one fragment corresponds to multiple image pixels
-	samplerInfo.minFilter = vk::Filter::eLinear; // when minified, ie one fragment is between image pixels
-	samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
-	samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
-	samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.magFilter = vk::Filter::eNearest; // noise is fetched per texel, filtering would blur it towards white noise
+	samplerInfo.minFilter = vk::Filter::eNearest;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eRepeat;
 	samplerInfo.anisotropyEnable = VK_FALSE;
 	samplerInfo.unnormalizedCoordinates = VK_FALSE; // true to sample using width/height coords instead of 0-1 range
 	samplerInfo.compareEnable = VK_FALSE;
@@ -1111,6 +1721,12 @@ void Primrose::createCommandPool() {
 	commandPool = device.createCommandPool(info);
 }
 
+void Primrose::createPipelineCache() {
+	log("Creating pipeline cache");
+
+	pipelineCache = device.createPipelineCache(vk::PipelineCacheCreateInfo());
+}
+
 void Primrose::createFramesInFlight() {
 	log("Creating frames in flight");
 
@@ -1137,12 +1753,26 @@ void Primrose::createFramesInFlight() {
 		fenceInfo.flags = vk::FenceCreateFlagBits::eSignaled; // default signaled on creation
 		frame.inFlightFence = device.createFence(fenceInfo);
 
+		// create timestamp queries
+		if (timestampPeriod != 0.f) {
+			frame.timestampPool = device.createQueryPool(vk::QueryPoolCreateInfo({}, vk::QueryType::eTimestamp, 2));
+		}
+
 		// create uniform buffers
 		createBuffer(sizeof(MarchUniforms), vk::BufferUsageFlagBits::eUniformBuffer,
 //			vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible,
 			vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible
 			| vk::MemoryPropertyFlagBits::eHostCoherent, // smart access memory (256 mb)
 			&frame.uniformBuffer, &frame.uniformBufferMemory);
+
+		// create step statistics buffer, read back on the cpu
+		if (computeMarch) {
+			createBuffer(sizeof(MarchStats), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+				&frame.statsBuffer, &frame.statsBufferMemory);
+			MarchStats zero{};
+			writeToDevice(frame.statsBufferMemory, &zero, sizeof(zero));
+		}
 	}
 }
 
@@ -1151,14 +1781,19 @@ void Primrose::createFramesInFlight() {
 void Primrose::cleanup() {
 	log("Cleaning up vulkan");
 
+	compiledShaders.clear();
+
 	// vulkan destruction
 	for (const auto& frame : framesInFlight) {
 		device.destroySemaphore(frame.imageAvailableSemaphore);
 		device.destroySemaphore(frame.renderFinishedSemaphore);
 		device.destroyFence(frame.inFlightFence);
+		device.destroyQueryPool(frame.timestampPool);
 
 		device.destroyBuffer(frame.uniformBuffer);
 		device.freeMemory(frame.uniformBufferMemory);
+		device.destroyBuffer(frame.statsBuffer);
+		device.freeMemory(frame.statsBufferMemory);
 	}
 
 	uiScene.clear();
@@ -1168,6 +1803,26 @@ void Primrose::cleanup() {
 	device.destroyImageView(marchImageView);
 	device.destroySampler(marchSampler);
 
+	device.destroyImageView(brickAtlasView);
+	device.destroyImage(brickAtlas);
+	device.freeMemory(brickAtlasMemory);
+	device.destroySampler(brickSampler);
+	device.destroyBuffer(brickCacheBuffer);
+	device.freeMemory(brickCacheBufferMemory);
+	device.destroyBuffer(brickSampleBuffer);
+	device.freeMemory(brickSampleBufferMemory);
+	device.destroyBuffer(brickProgramBuffer);
+	device.freeMemory(brickProgramBufferMemory);
+
+	device.destroyImageView(noiseVolumeView);
+	device.destroyImage(noiseVolume);
+	device.freeMemory(noiseVolumeMemory);
+	device.destroySampler(noiseSampler);
+
+	device.destroyImageView(clipmapView);
+	device.destroyImage(clipmap);
+	device.freeMemory(clipmapMemory);
+
 	device.destroyCommandPool(commandPool);
 
 	device.destroyPipeline(uiPipeline);
@@ -1177,15 +1832,25 @@ void Primrose::cleanup() {
 	device.destroyAccelerationStructureKHR(topStructure);
 	device.destroyBuffer(topStructureBuffer);
 	device.freeMemory(topStructureMemory);
-	device.destroyAccelerationStructureKHR(aabbStructure);
-	device.destroyBuffer(aabbStructureBuffer);
-	device.freeMemory(aabbStructureMemory);
+	for (const auto& blas : bottomStructures) {
+		device.destroyAccelerationStructureKHR(blas.structure);
+		device.destroyBuffer(blas.buffer);
+		device.freeMemory(blas.memory);
+	}
+	device.destroyBuffer(attributeBuffer);
+	device.freeMemory(attributeMemory);
+	device.destroyBuffer(instanceBuffer);
+	device.freeMemory(instanceMemory);
+	device.destroyBuffer(structureScratchBuffer);
+	device.freeMemory(structureScratchMemory);
 
 	device.destroyBuffer(rayShaderTable);
 	device.freeMemory(rayShaderTableMemory);
 
 	device.destroyPipeline(mainPipeline);
+	destroyComputePipeline();
 	device.destroyPipelineLayout(mainPipelineLayout);
+	device.destroyPipelineCache(pipelineCache);
 	device.destroyDescriptorSetLayout(mainDescriptorLayout);
 
 	cleanupSwapchain();
@@ -1208,18 +1873,36 @@ void Primrose::cleanup() {
 void Primrose::cleanupSwapchain() {
 	log("Cleaning up swapchain");
 
-	if (rayAcceleration) {
+	if (rayAcceleration || computeMarch) {
 		device.destroyImageView(traceImageView);
 		device.freeMemory(traceImageMemory);
 		device.destroyImage(traceImage);
 	}
+	if (computeMarch) {
+		for (auto& image : historyColorImages) destroyStorageImage(image);
+		for (auto& image : historyDepthImages) destroyStorageImage(image);
+		destroyStorageImage(motionImage);
+		destroyStorageImage(surfaceImage);
+		destroyStorageImage(coneImage);
+		destroyStorageImage(bounceHeadImage);
+		destroyStorageImage(bounceCountImage);
+		destroyStorageImage(bounceImage);
+		device.destroyBuffer(bounceRayBuffer);
+		device.freeMemory(bounceRayBufferMemory);
+		device.destroyBuffer(bounceCounterBuffer);
+		device.freeMemory(bounceCounterBufferMemory);
+	}
 
 	for (const auto& frame : swapchainFrames) {
 		device.destroyFramebuffer(frame.framebuffer);
 		device.destroyImageView(frame.imageView);
+		device.destroyImageView(frame.storageView);
 	}
 
 	device.destroySwapchainKHR(swapchain);
+
+	for (auto& old : retiredSwapchains) destroyRetiredSwapchain(old);
+	retiredSwapchains.clear();
 }
 
 void Primrose::recreateSwapchain() {
@@ -1230,15 +1913,68 @@ void Primrose::recreateSwapchain() {
 		return;
 	}
 
-	device.waitIdle();
-
-	cleanupSwapchain();
+	// frames in flight may still use the old swapchain, so it is destroyed later by releaseRetiredSwapchains
+	RetiredSwapchain old{frameIndex, swapchain, std::move(swapchainFrames), {}, {}};
 
 	createSwapchain();
 	createSwapchainFrames();
-	if (rayAcceleration) createTraceImage();
 
-	//for (auto& frame : framesInFlight) {
-	//	frame.uniforms.screenHeight = (float)swapchainExtent.height / (float)swapchainExtent.width;
-	//}
+	// storage images have headroom, so they are only replaced once the swapchain outgrows them
+	if ((rayAcceleration || computeMarch)
+		&& (swapchainExtent.width > storageExtent.width || swapchainExtent.height > storageExtent.height)) {
+
+		old.images.push_back(StorageImage{traceImage, traceImageMemory, traceImageView});
+		if (computeMarch) {
+			old.images.insert(old.images.end(), historyColorImages.begin(), historyColorImages.end());
+			old.images.insert(old.images.end(), historyDepthImages.begin(), historyDepthImages.end());
+			old.images.push_back(motionImage);
+			old.images.push_back(surfaceImage);
+			old.images.push_back(coneImage);
+			old.images.push_back(bounceHeadImage);
+			old.images.push_back(bounceCountImage);
+			old.images.push_back(bounceImage);
+			old.buffers.emplace_back(bounceRayBuffer, bounceRayBufferMemory);
+			old.buffers.emplace_back(bounceCounterBuffer, bounceCounterBufferMemory);
+		}
+
+		chooseStorageExtent();
+		createTraceImage();
+		if (computeMarch) {
+			createHistoryImages();
+			createConeImage();
+			createBounceQueue();
+		}
+	}
+	retiredSwapchains.push_back(std::move(old));
+
+	uniforms.screenHeight = static_cast<float>(swapchainExtent.height) / static_cast<float>(swapchainExtent.width);
+}
+
+void Primrose::recreatePipelines() {
+	// the accelerated pipeline is built along with its scene, updateAcceleratedScene regenerates it when the
+	// quality changed
+	if (rayAcceleration) return;
+
+	log("Recreating pipelines");
+
+	device.waitIdle(); // frames in flight may still have the old pipelines bound
+
+	if (computeMarch) {
+		destroyComputePipeline();
+		createComputePipeline();
+	} else {
+		device.destroyPipeline(mainPipeline);
+		createRasterPipeline();
+	}
+	historyValid = false;
+}
+
+void Primrose::releaseRetiredSwapchains() {
+	// called after waiting on the current frame's fence, so every frame this many frames old has finished
+	while (!retiredSwapchains.empty()
+		&& frameIndex >= retiredSwapchains.front().frame + static_cast<unsigned int>(MAX_FRAMES_IN_FLIGHT)) {
+
+		destroyRetiredSwapchain(retiredSwapchains.front());
+		retiredSwapchains.erase(retiredSwapchains.begin());
+	}
 }
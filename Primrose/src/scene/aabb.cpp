@@ -42,6 +42,13 @@ bool AABB::isEmpty() {
 	return glm::all(glm::isnan(min)) || glm::all(glm::isnan(max));
 }
 
+float AABB::surfaceArea() {
+	if (isEmpty()) return 0;
+
+	glm::vec3 size = max - min;
+	return 2.f * (size.x*size.y + size.y*size.z + size.z*size.x);
+}
+
 void AABB::addPoint(glm::vec3 p) {
 	if (isEmpty()) {
 		min = p;
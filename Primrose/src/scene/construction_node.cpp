@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cmath>
 #include "scene/construction_node.hpp"
 #include "scene/node_visitor.hpp"
 
@@ -11,7 +12,7 @@ bool ConstructionNode::createOperations(const std::vector<Primitive>& prims,
 
 	uint lastChildIndex = -1;
 	for (const auto& child : getChildren()) {
-		if (child->createOperations(prims, transforms, ops)) {
+		if (child->appendOperations(prims, transforms, ops)) {
 			if (lastChildIndex != -1) {
 				ops.push_back(foldOperations(lastChildIndex, ops.size() - 1));
 			}
@@ -23,18 +24,28 @@ bool ConstructionNode::createOperations(const std::vector<Primitive>& prims,
 }
 
 namespace {
-	static std::string foldGlsl(std::vector<Node*> nodes, std::string operation) {
-		if (nodes.size() == 0) return "";
-		if (nodes.size() == 1) return nodes[0]->generateIntersectionGlsl();
-
-		std::string start = "";
-		std::string end = nodes[0]->generateIntersectionGlsl();
-		for (int i = 1; i < nodes.size(); ++i) {
-			start += fmt::format("{}(", operation);
-			end += fmt::format(", {})", nodes[i]->generateIntersectionGlsl());
+	static std::string foldGlsl(std::vector<Node*> nodes, Node* space, std::string operation) {
+		std::string glsl = "";
+		for (Node* node : nodes) {
+			std::string nodeGlsl = node->generateIntersectionGlsl(space);
+			if (nodeGlsl.empty()) continue; // hidden
+
+			if (glsl.empty()) glsl = nodeGlsl;
+			else glsl = fmt::format("{}({}, {})", operation, glsl, nodeGlsl);
 		}
 
-		return start + end;
+		return glsl;
+	}
+
+	// interval of the union of nodes, the interval of no nodes is infinite like a hidden node's
+	static Interval unionIntervals(std::vector<Node*> nodes, AABB cell, Node* space) {
+		Interval interval = {INFINITY, INFINITY};
+		for (Node* node : nodes) {
+			Interval nodeInterval = node->distanceInterval(cell, space);
+			interval = {std::min(interval.min, nodeInterval.min), std::min(interval.max, nodeInterval.max)};
+		}
+
+		return interval;
 	}
 
 	static std::vector<Node*> toRaw(const std::vector<std::unique_ptr<Node>>& nodes) {
@@ -58,16 +69,28 @@ void UnionNode::serialize(rapidjson::Writer<rapidjson::OStreamWrapper>& writer)
 	writer.String("union");
 	Node::serialize(writer);
 }
-std::string UnionNode::generateIntersectionGlsl() {
-	return foldGlsl(toRaw(getChildren()), "union");
+std::string UnionNode::generateIntersectionGlsl(Node* space) {
+	if (shouldHide()) return "";
+	return foldGlsl(toRaw(getChildren()), space, "opUnion");
+}
+void UnionNode::generateIntersectionTerms(Node* space, std::vector<IntersectionTerm>& terms) {
+	if (shouldHide()) return;
+
+	for (const auto& child : getChildren()) {
+		child->generateIntersectionTerms(space, terms);
+	}
 }
-AABB UnionNode::generateAabb() {
+AABB UnionNode::generateAabb(Node* space) {
 	AABB aabb;
 	for (const auto& child : getChildren()) {
-		aabb.unionWith(child->generateAabb());
+		aabb.unionWith(child->generateAabb(space));
 	}
 	return aabb;
 }
+Interval UnionNode::distanceInterval(AABB cell, Node* space) {
+	if (shouldHide()) return {INFINITY, INFINITY};
+	return unionIntervals(toRaw(getChildren()), cell, space);
+}
 
 IntersectionNode::IntersectionNode(Primrose::Node* parent) : ConstructionNode(parent) { name = "Intersection"; }
 Operation IntersectionNode::foldOperations(uint i, uint j) {
@@ -81,15 +104,36 @@ void IntersectionNode::serialize(rapidjson::Writer<rapidjson::OStreamWrapper>& w
 	writer.String("intersection");
 	Node::serialize(writer);
 }
-std::string IntersectionNode::generateIntersectionGlsl() {
-	return foldGlsl(toRaw(getChildren()), "intersection");
+std::string IntersectionNode::generateIntersectionGlsl(Node* space) {
+	if (shouldHide()) return "";
+	return foldGlsl(toRaw(getChildren()), space, "opIntersection");
 }
-AABB IntersectionNode::generateAabb() {
+AABB IntersectionNode::generateAabb(Node* space) {
 	AABB aabb;
+	bool first = true;
 	for (const auto& child : getChildren()) {
-		aabb.intersectWith(child->generateAabb());
+		if (child->shouldHide()) continue; // left out of the glsl, so not intersected with
+
+		if (first) aabb = child->generateAabb(space);
+		else aabb.intersectWith(child->generateAabb(space));
+		first = false;
 	}
-	return aabb;
+	return aabb; // also holds the parts of each child outside the others, tightenAabb can drop them
+}
+Interval IntersectionNode::distanceInterval(AABB cell, Node* space) {
+	if (shouldHide()) return {INFINITY, INFINITY};
+
+	Interval interval = {INFINITY, INFINITY};
+	bool first = true;
+	for (const auto& child : getChildren()) {
+		Interval childInterval = child->distanceInterval(cell, space);
+		if (childInterval.min == INFINITY) continue; // hidden
+
+		if (first) interval = childInterval;
+		else interval = {std::max(interval.min, childInterval.min), std::max(interval.max, childInterval.max)};
+		first = false;
+	}
+	return interval;
 }
 
 DifferenceNode::DifferenceNode(Primrose::Node* parent) : Node(parent) { name = "Difference"; }
@@ -103,7 +147,7 @@ bool DifferenceNode::createOperations(const std::vector<Primitive>& prims,
 	uint lastBaseIndex = -1;
 	uint lastSubtractIndex = -1;
 	for (const auto& child : getChildren()) {
-		if (child->createOperations(prims, transforms, ops)) {
+		if (child->appendOperations(prims, transforms, ops)) {
 			if (!subtractNodes.contains(child.get())) {
 				if (lastBaseIndex != -1) {
 					ops.push_back(Operation::Union(lastBaseIndex, ops.size() - 1));
@@ -146,7 +190,9 @@ void DifferenceNode::serialize(rapidjson::Writer<rapidjson::OStreamWrapper>& wri
 	}
 	Node::serialize(writer);
 }
-std::string DifferenceNode::generateIntersectionGlsl() {
+std::string DifferenceNode::generateIntersectionGlsl(Node* space) {
+	if (shouldHide()) return "";
+
 	std::vector<Node*> baseNodes;
 	std::vector<Node*> subNodes;
 	for (const auto& child : getChildren()) {
@@ -157,21 +203,42 @@ std::string DifferenceNode::generateIntersectionGlsl() {
 		}
 	}
 
-	if (baseNodes.size() == 0) return "";
-	std::string baseGlsl = foldGlsl(baseNodes, "union");
+	std::string baseGlsl = foldGlsl(baseNodes, space, "opUnion");
+	if (baseGlsl.empty()) return "";
 
-	if (subNodes.size() == 0) return baseGlsl;
-	std::string subGlsl = foldGlsl(subNodes, "union");
+	std::string subGlsl = foldGlsl(subNodes, space, "opUnion");
+	if (subGlsl.empty()) return baseGlsl;
 
-	return fmt::format("difference({}, {})", baseGlsl, subGlsl);
+	return fmt::format("opDifference({}, {})", baseGlsl, subGlsl);
 }
-AABB DifferenceNode::generateAabb() {
+AABB DifferenceNode::generateAabb(Node* space) {
 	AABB aabb;
 	for (const auto& child : getChildren()) {
 		if (!subtractNodes.contains(child.get())) {
-			aabb.unionWith(child->generateAabb());
+			aabb.unionWith(child->generateAabb(space));
 		}
-		// can't diffWith subtract AABBs since they only bound the volume which subtracts
 	}
+	// can't diffWith subtract AABBs since they only bound the volume which subtracts, tightenAabb can drop the
+	// cells they carve out entirely
 	return aabb;
 }
+Interval DifferenceNode::distanceInterval(AABB cell, Node* space) {
+	if (shouldHide()) return {INFINITY, INFINITY};
+
+	std::vector<Node*> baseNodes;
+	std::vector<Node*> subNodes;
+	for (const auto& child : getChildren()) {
+		if (subtractNodes.contains(child.get())) {
+			subNodes.push_back(child.get());
+		} else {
+			baseNodes.push_back(child.get());
+		}
+	}
+
+	// max(base, -sub) like opDifference, an infinite sub interval leaves the base unchanged
+	Interval base = unionIntervals(baseNodes, cell, space);
+	if (base.min == INFINITY) return base;
+
+	Interval sub = unionIntervals(subNodes, cell, space);
+	return {std::max(base.min, -sub.max), std::max(base.max, -sub.min)};
+}
@@ -1,7 +1,9 @@
 #include "scene/node.hpp"
+#include "state.hpp"
 
 #include <glm/geometric.hpp>
 #include <iostream>
+#include <cmath>
 
 using namespace Primrose;
 
@@ -140,18 +142,70 @@ glm::mat4 Node::modelMatrix() {
 	return matrix;
 }
 
+glm::mat4 Node::modelMatrix(Node* space) {
+	if (space == nullptr) return modelMatrix();
+	if (space == this) return glm::mat4(1);
+
+	glm::mat4 matrix = parent->modelMatrix(space);
+	matrix = glm::translate(matrix, translate);
+	matrix = glm::rotate(matrix, glm::radians(angle), axis);
+	matrix = glm::scale(matrix, scale);
+	return matrix;
+}
+
+void Node::generateIntersectionTerms(Node* space, std::vector<IntersectionTerm>& terms) {
+	std::string glsl = generateIntersectionGlsl(space);
+	if (!glsl.empty()) terms.push_back(IntersectionTerm(glsl, tightenAabb(generateAabb(space), space)));
+}
+
+namespace {
+	// adds the parts of cell the sdf of node could be negative in to tight, halving cell depth more times
+	static void tightenCell(Node* node, Node* space, AABB cell, uint depth, AABB& tight) {
+		glm::vec3 min = cell.getMin();
+		glm::vec3 max = cell.getMax();
+		if (tight.contains(min) && tight.contains(max)) return; // can't grow tight
+
+		Interval interval = node->distanceInterval(cell, space);
+		// cells entirely inside are kept, aabb might not reach past the surface there
+		if (interval.min > 0) return; // entirely outside, so no surface
+
+		if (depth == 0) {
+			tight.unionWith(cell);
+			return;
+		}
+
+		glm::vec3 centre = 0.5f * (min + max);
+		for (int i = 0; i < 8; ++i) {
+			glm::vec3 corner = glm::vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+			tightenCell(node, space, AABB::fromPoints({centre, corner}), depth - 1, tight);
+		}
+	}
+}
+
+AABB Node::tightenAabb(AABB aabb, Node* space) {
+	if (aabb.isEmpty()) return aabb;
+
+	AABB tight;
+	tightenCell(this, space, aabb, Settings::boundsSubdivisions, tight);
+	return tight;
+}
+
 glm::mat4 RootNode::modelMatrix() {
 	return glm::mat4(1);
 }
 
-std::string RootNode::generateIntersectionGlsl() {
+std::string RootNode::generateIntersectionGlsl(Node* space) {
 	return "";
 }
 
-AABB RootNode::generateAabb() {
+AABB RootNode::generateAabb(Node* space) {
 	return AABB();
 }
 
+Interval RootNode::distanceInterval(AABB cell, Node* space) {
+	return {INFINITY, INFINITY};
+}
+
 bool Node::shouldHide() {
 	return hide || glm::determinant(modelMatrix()) == 0;
 }
@@ -164,6 +218,11 @@ void Node::serialize(rapidjson::Writer<rapidjson::OStreamWrapper>& writer) {
 	writer.String("name");
 	writer.String(name.c_str());
 
+	if (isStatic) {
+		writer.String("static");
+		writer.Bool(true);
+	}
+
 	if (translate != glm::vec3(0) || scale != glm::vec3(1) || angle != 0) {
 		writer.String("transform");
 		writer.StartObject();
@@ -242,14 +301,38 @@ std::vector<Transformation> Node::extractTransforms() {
 	return transforms;
 }
 
+bool Node::appendOperations(const std::vector<Primitive>& prims,
+	const std::vector<Transformation>& transforms, std::vector<Operation>& ops) {
+
+	if (brickVolume == -1) return createOperations(prims, transforms, ops);
+
+	// the marcher samples the volume and skips to the subtree's result, the rest still evaluate it exactly
+	uint brickIndex = ops.size();
+	ops.push_back(Operation::Brick(brickVolume, 0));
+	if (!createOperations(prims, transforms, ops)) {
+		ops.resize(brickIndex);
+		return false;
+	}
+	ops[brickIndex].j = ops.size() - 1;
+	return true;
+}
+
 bool RootNode::createOperations(const std::vector<Primitive>& prims,
 	const std::vector<Transformation>& transforms, std::vector<Operation>& ops) {
 
+	return createOperations(prims, transforms, ops, nullptr);
+}
+
+bool RootNode::createOperations(const std::vector<Primitive>& prims,
+	const std::vector<Transformation>& transforms, std::vector<Operation>& ops, std::vector<AABB>* groupAabbs) {
+
 	bool shouldRender = false;
 
 	for (const auto& child : getChildren()) {
-		if (child->createOperations(prims, transforms, ops)) {
-			ops.push_back(Operation::Render(ops.size() - 1));
+		uint groupStart = ops.size();
+		if (child->appendOperations(prims, transforms, ops)) {
+			ops.push_back(Operation::Render(ops.size() - 1, groupStart));
+			if (groupAabbs != nullptr) groupAabbs->push_back(child->tightenAabb(child->generateAabb()));
 			shouldRender = true;
 		}
 	}
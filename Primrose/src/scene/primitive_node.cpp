@@ -1,5 +1,7 @@
 #include <iostream>
 #include <glm/gtx/string_cast.hpp>
+#include <algorithm>
+#include <cmath>
 #include "scene/primitive_node.hpp"
 #include "scene/node_visitor.hpp"
 
@@ -95,6 +97,59 @@ namespace {
 	}
 }
 
+std::string PrimitiveNode::generateIntersectionGlsl(Node* space) {
+	if (shouldHide()) return "";
+
+	std::string glsl = primitiveGlsl(space);
+	std::string childGlsl = UnionNode::generateIntersectionGlsl(space);
+	if (childGlsl.empty()) return glsl;
+	return fmt::format("opUnion({}, {})", childGlsl, glsl);
+}
+
+AABB PrimitiveNode::generateAabb(Node* space) {
+	AABB aabb = primitiveAabb(space);
+	aabb.unionWith(UnionNode::generateAabb(space));
+	return aabb;
+}
+
+Interval PrimitiveNode::distanceInterval(AABB cell, Node* space) {
+	if (shouldHide()) return {INFINITY, INFINITY};
+
+	// primitiveDistance is 1-lipschitz, so over the cell's bounds in primitive space it stays within their
+	// radius of its value at their centre, widened by the slack, then it's scaled like placeGlsl
+	glm::mat4 matrix = modelMatrix(space);
+	AABB local = cell;
+	local.applyTransform(glm::inverse(matrix));
+	glm::vec3 centre = 0.5f * (local.getMin() + local.getMax());
+	float radius = glm::length(local.getMax() - centre) + primitiveSlack();
+	float distance = primitiveDistance(centre);
+	float smallScale = getSmallScale(matrix);
+
+	Interval children = UnionNode::distanceInterval(cell, space);
+	return {std::min((distance - radius) * smallScale, children.min),
+		std::min((distance + radius) * smallScale, children.max)};
+}
+
+void PrimitiveNode::generateIntersectionTerms(Node* space, std::vector<IntersectionTerm>& terms) {
+	if (shouldHide()) return;
+
+	terms.push_back(IntersectionTerm(primitiveGlsl(space), primitiveAabb(space)));
+	UnionNode::generateIntersectionTerms(space, terms);
+}
+
+std::string PrimitiveNode::placeGlsl(Node* space, std::string function, std::string args) {
+	// same evaluation as an OP_TRANSFORM then OP_IDENTITY pair in march.glsl, so the primitive parameters
+	// match toPrimitive and the scale is applied by the model matrix
+	glm::mat4 matrix = modelMatrix(space);
+	return fmt::format("{}(transform(p, {}){}) * {}", function, glmToGlsl(glm::inverse(matrix)), args,
+		getSmallScale(matrix));
+}
+
+AABB PrimitiveNode::placeAabb(Node* space, AABB local) {
+	local.applyTransform(modelMatrix(space));
+	return local;
+}
+
 SphereNode::SphereNode(Primrose::Node *parent, float radius) : PrimitiveNode(parent) {
 	name = "Sphere";
 	this->radius = radius;
@@ -113,13 +168,14 @@ void SphereNode::serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer)
 Primitive SphereNode::toPrimitive() {
 	return Primitive::Sphere();
 }
-std::string SphereNode::generateIntersectionGlsl() {
-	return fmt::format("sphereSDF({} * p, {})", glmToGlsl(glm::inverse(modelMatrix())), radius);
+std::string SphereNode::primitiveGlsl(Node* space) {
+	return placeGlsl(space, "sphereSDF");
 }
-AABB SphereNode::generateAabb() {
-	AABB aabb = AABB::fromPoints({-glm::vec3(radius), glm::vec3(radius)});
-	aabb.applyTransform(modelMatrix());
-	return aabb;
+AABB SphereNode::primitiveAabb(Node* space) {
+	return placeAabb(space, AABB::fromPoints({glm::vec3(-1), glm::vec3(1)})); // sphereSDF has radius 1
+}
+float SphereNode::primitiveDistance(glm::vec3 p) {
+	return glm::length(p) - 1.f;
 }
 
 BoxNode::BoxNode(Primrose::Node *parent, glm::vec3 size) : PrimitiveNode(parent) {
@@ -145,14 +201,15 @@ void BoxNode::serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer) {
 Primitive BoxNode::toPrimitive() {
 	return Primitive::Box();
 }
-std::string BoxNode::generateIntersectionGlsl() {
-	return fmt::format("boxSDF({} * p, vec3({}, {}, {}))", glmToGlsl(glm::inverse(modelMatrix())),
-		size.x, size.y, size.z);
+std::string BoxNode::primitiveGlsl(Node* space) {
+	return placeGlsl(space, "cubeSDF");
 }
-AABB BoxNode::generateAabb() {
-	AABB aabb = AABB::fromPoints({-0.5f * size, 0.5f * size});
-	aabb.applyTransform(modelMatrix());
-	return aabb;
+AABB BoxNode::primitiveAabb(Node* space) {
+	return placeAabb(space, AABB::fromPoints({glm::vec3(-1), glm::vec3(1)})); // cubeSDF has half extent 1
+}
+float BoxNode::primitiveDistance(glm::vec3 p) {
+	glm::vec3 q = glm::abs(p) - 1.f;
+	return glm::length(glm::max(q, 0.f)) + std::min(std::max(q.x, std::max(q.y, q.z)), 0.f);
 }
 
 
@@ -178,13 +235,15 @@ void TorusNode::serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer)
 Primitive TorusNode::toPrimitive() {
 	return Primitive::Torus(ringRadius / majorRadius);
 }
-std::string TorusNode::generateIntersectionGlsl() {
-	return fmt::format("torusSDF({} * p, {}, {})", glmToGlsl(glm::inverse(modelMatrix())), majorRadius, ringRadius);
+std::string TorusNode::primitiveGlsl(Node* space) {
+	return placeGlsl(space, "torusSDF", fmt::format(", 1, {}", ringRadius / majorRadius));
 }
-AABB TorusNode::generateAabb() {
-	AABB aabb = AABB::fromPoints({-glm::vec3(majorRadius + ringRadius), glm::vec3(majorRadius + ringRadius)});
-	aabb.applyTransform(modelMatrix());
-	return aabb;
+AABB TorusNode::primitiveAabb(Node* space) {
+	float ring = ringRadius / majorRadius; // major radius 1, like toPrimitive
+	return placeAabb(space, AABB::fromPoints({-glm::vec3(1 + ring, ring, 1 + ring), glm::vec3(1 + ring, ring, 1 + ring)}));
+}
+float TorusNode::primitiveDistance(glm::vec3 p) {
+	return glm::length(glm::vec2(glm::length(glm::vec2(p.x, p.z)) - 1.f, p.y)) - ringRadius / majorRadius;
 }
 
 
@@ -210,13 +269,16 @@ void LineNode::serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer) {
 Primitive LineNode::toPrimitive() {
 	return Primitive::Line(height*0.5 / radius);
 }
-std::string LineNode::generateIntersectionGlsl() {
-	return fmt::format("lineSDF({} * p, {}, {})", glmToGlsl(glm::inverse(modelMatrix())), height, radius);
+std::string LineNode::primitiveGlsl(Node* space) {
+	return placeGlsl(space, "lineSDF", fmt::format(", {}, 1", height*0.5 / radius));
 }
-AABB LineNode::generateAabb() {
-	AABB aabb = AABB::fromPoints({-glm::vec3(radius, height*0.5, radius), glm::vec3(radius, height*0.5, radius)});
-	aabb.applyTransform(modelMatrix());
-	return aabb;
+AABB LineNode::primitiveAabb(Node* space) {
+	float halfHeight = height*0.5f / radius; // radius 1 from y = 0 up to halfHeight, like toPrimitive
+	return placeAabb(space, AABB::fromPoints({glm::vec3(-1), glm::vec3(1, halfHeight + 1, 1)}));
+}
+float LineNode::primitiveDistance(glm::vec3 p) {
+	p.y -= std::clamp(p.y, 0.f, height*0.5f / radius);
+	return glm::length(p) - 1.f;
 }
 
 
@@ -238,11 +300,85 @@ void CylinderNode::serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &write
 Primitive CylinderNode::toPrimitive() {
 	return Primitive::Cylinder();
 }
-std::string CylinderNode::generateIntersectionGlsl() {
-	return fmt::format("cylinderSDF({} * p, {})", glmToGlsl(glm::inverse(modelMatrix())), radius);
+std::string CylinderNode::primitiveGlsl(Node* space) {
+	return placeGlsl(space, "cylinderSDF", ", 1");
 }
-AABB CylinderNode::generateAabb() {
-	AABB aabb = AABB::fromPoints({-glm::vec3(radius, 1000, radius), glm::vec3(radius, 1000, radius)});
-	aabb.applyTransform(modelMatrix());
-	return aabb;
+AABB CylinderNode::primitiveAabb(Node* space) {
+	return placeAabb(space, AABB::fromPoints({-glm::vec3(1, 1000, 1), glm::vec3(1, 1000, 1)})); // radius 1
+}
+float CylinderNode::primitiveDistance(glm::vec3 p) {
+	return glm::length(glm::vec2(p.x, p.z)) - 1.f;
+}
+
+
+NoiseRockNode::NoiseRockNode(Primrose::Node *parent, float height, float frequency) : PrimitiveNode(parent) {
+	name = "Rock";
+	this->height = height;
+	this->frequency = frequency;
+}
+void NoiseRockNode::accept(NodeVisitor *visitor) { visitor->visit(this); }
+std::string NoiseRockNode::toString(std::string prefix) {
+	return fmt::format("{}{}/noiseRock(" "height" "={}" "frequency" "={}" "){}", prefix, name, height, frequency,
+		Node::toString());
+}
+void NoiseRockNode::serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer) {
+	writer.String("type");
+	writer.String("noiseRock");
+	writer.String("height");
+	writer.Double(height);
+	writer.String("frequency");
+	writer.Double(frequency);
+	Node::serialize(writer);
+}
+Primitive NoiseRockNode::toPrimitive() {
+	return Primitive::NoiseRock(height, frequency);
+}
+std::string NoiseRockNode::primitiveGlsl(Node* space) {
+	return placeGlsl(space, "noiseRockSDF", fmt::format(", {}, {}", height, frequency));
+}
+AABB NoiseRockNode::primitiveAabb(Node* space) {
+	return placeAabb(space, AABB::fromPoints({-glm::vec3(1 + height), glm::vec3(1 + height)})); // bumps up to height
+}
+float NoiseRockNode::primitiveDistance(glm::vec3 p) {
+	return glm::length(p) - 1.f - 0.5f * height; // the surface is between radius 1 and 1 + height
+}
+float NoiseRockNode::primitiveSlack() {
+	return 0.5f * height;
+}
+
+
+NoiseTerrainNode::NoiseTerrainNode(Primrose::Node *parent, float height, float frequency) : PrimitiveNode(parent) {
+	name = "Terrain";
+	this->height = height;
+	this->frequency = frequency;
+}
+void NoiseTerrainNode::accept(NodeVisitor *visitor) { visitor->visit(this); }
+std::string NoiseTerrainNode::toString(std::string prefix) {
+	return fmt::format("{}{}/noiseTerrain(" "height" "={}" "frequency" "={}" "){}", prefix, name, height, frequency,
+		Node::toString());
+}
+void NoiseTerrainNode::serialize(rapidjson::Writer<rapidjson::OStreamWrapper> &writer) {
+	writer.String("type");
+	writer.String("noiseTerrain");
+	writer.String("height");
+	writer.Double(height);
+	writer.String("frequency");
+	writer.Double(frequency);
+	Node::serialize(writer);
+}
+Primitive NoiseTerrainNode::toPrimitive() {
+	return Primitive::NoiseTerrain(height, frequency);
+}
+std::string NoiseTerrainNode::primitiveGlsl(Node* space) {
+	return placeGlsl(space, "noiseTerrainSDF", fmt::format(", {}, {}", height, frequency));
+}
+AABB NoiseTerrainNode::primitiveAabb(Node* space) {
+	// solid below the ground, bounded like the cylinder
+	return placeAabb(space, AABB::fromPoints({-glm::vec3(1000, 1000, 1000), glm::vec3(1000, height, 1000)}));
+}
+float NoiseTerrainNode::primitiveDistance(glm::vec3 p) {
+	return p.y - 0.5f * height; // the ground is between y = 0 and height
+}
+float NoiseTerrainNode::primitiveSlack() {
+	return 0.5f * height;
 }
@@ -3,6 +3,7 @@
 #include "scene/primitive_node.hpp"
 #include "scene/construction_node.hpp"
 #include "state.hpp"
+#include "log.hpp"
 
 #include <rapidjson/document.h>
 #include <rapidjson/filereadstream.h>
@@ -11,9 +12,29 @@
 #include <rapidjson/writer.h>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cmath>
 
 using namespace Primrose;
 
+namespace {
+	// outermost static nodes, the nodes inside them are baked along with them, every node is reset to unbaked
+	static void findStaticNodes(const std::vector<std::unique_ptr<Node>>& children, bool insideStatic,
+		std::vector<Node*>& found) {
+
+		for (const auto& child : children) {
+			child->brickVolume = -1;
+			bool baked = child->isStatic && !insideStatic;
+			if (baked) found.push_back(child.get());
+			findStaticNodes(child->getChildren(), insideStatic || baked, found);
+		}
+	}
+
+	static void appendKey(std::string& key, const void* data, size_t size) {
+		key.append(static_cast<const char*>(data), size);
+	}
+}
+
 Scene::Scene(std::filesystem::path sceneFile) {
 	importScene(sceneFile);
 }
@@ -64,6 +85,10 @@ Node* Scene::processJson(Node* parent, const rapidjson::Value& v, std::filesyste
 		node = new LineNode(parent, v["height"].GetFloat(), v["radius"].GetFloat());
 	} else if (type == "cylinder") {
 		node = new CylinderNode(parent, v["radius"].GetFloat());
+	} else if (type == "noiseRock") {
+		node = new NoiseRockNode(parent, v["height"].GetFloat(), v["frequency"].GetFloat());
+	} else if (type == "noiseTerrain") {
+		node = new NoiseTerrainNode(parent, v["height"].GetFloat(), v["frequency"].GetFloat());
 	} else if (type == "union") {
 		node = new UnionNode(parent);
 	} else if (type == "intersection") {
@@ -75,6 +100,9 @@ Node* Scene::processJson(Node* parent, const rapidjson::Value& v, std::filesyste
 	if (v.HasMember("name")) {
 		node->name = v["name"].GetString();
 	}
+	if (v.HasMember("static")) {
+		node->isStatic = v["static"].GetBool();
+	}
 
 	if (v.HasMember("children")) {
 		for (const auto& child : v["children"].GetArray()) {
@@ -202,7 +230,59 @@ void Primrose::Scene::generateUniforms() {
 	std::vector<Primitive> prims = root.extractPrims();
 	std::vector<Transformation> transforms = root.extractTransforms();
 	std::vector<Operation> ops;
-	root.createOperations(prims, transforms, ops);
+	std::vector<AABB> groupAabbs;
+
+	// static subtrees get a grid of brick cache cells over their bounds, padded by a cell on every side
+	std::vector<Node*> staticNodes;
+	findStaticNodes(root.getChildren(), false, staticNodes);
+
+	std::vector<StaticSubtree> subtrees;
+	uint numCells = 0;
+	for (Node* node : staticNodes) {
+		if (subtrees.size() == MAX_BRICK_VOLUMES) {
+			warning(fmt::format("Too many static nodes, {} is not baked", node->name));
+			continue;
+		}
+
+		StaticSubtree subtree;
+		AABB aabb = node->tightenAabb(node->generateAabb());
+		if (aabb.isEmpty() || !node->createOperations(prims, transforms, subtree.operations)) continue;
+		subtree.operations.push_back(Operation::Render(subtree.operations.size() - 1, 0));
+
+		glm::vec3 size = aabb.getMax() - aabb.getMin();
+		float cellSize = std::max(size.x, std::max(size.y, size.z)) / static_cast<float>(Settings::brickResolution);
+		if (!std::isfinite(cellSize) || cellSize <= 0) continue;
+
+		subtree.volume.min = aabb.getMin() - cellSize;
+		subtree.volume.cellSize = cellSize;
+		subtree.volume.dims = glm::min(glm::uvec3(glm::ceil(size / cellSize)), glm::uvec3(Settings::brickResolution))
+			+ 2u;
+		subtree.volume.firstCell = numCells;
+		numCells += subtree.volume.dims.x * subtree.volume.dims.y * subtree.volume.dims.z;
+
+		// indices into prims and transforms move as the rest of the scene changes, so the key holds what they point to
+		appendKey(subtree.key, &subtree.volume, sizeof(BrickVolume));
+		for (const Operation& op : subtree.operations) {
+			if (op.type == OP::IDENTITY) {
+				appendKey(subtree.key, &op.j, sizeof(op.j));
+				appendKey(subtree.key, &prims[op.i], sizeof(Primitive));
+			} else if (op.type == OP::TRANSFORM) {
+				appendKey(subtree.key, &transforms[op.i], sizeof(Transformation));
+			} else {
+				appendKey(subtree.key, &op, sizeof(Operation));
+			}
+		}
+
+		node->brickVolume = subtrees.size();
+		subtrees.push_back(std::move(subtree));
+	}
+
+	bool unchanged = std::equal(subtrees.begin(), subtrees.end(), staticSubtrees.begin(), staticSubtrees.end(),
+		[](const StaticSubtree& a, const StaticSubtree& b) { return a.key == b.key; });
+	if (!unchanged) bricksBaked = false;
+	staticSubtrees = std::move(subtrees);
+
+	root.createOperations(prims, transforms, ops, &groupAabbs);
 
 	if (prims.size() > 100 || transforms.size() > 100 || ops.size() > 100) {
 		throw std::runtime_error("vector exceeded buffer size");
@@ -212,4 +292,16 @@ void Primrose::Scene::generateUniforms() {
 	std::copy(ops.begin(), ops.end(), uniforms.operations);
 	std::copy(prims.begin(), prims.end(), uniforms.primitives);
 	std::copy(transforms.begin(), transforms.end(), uniforms.transformations);
+
+	// bounds are stored at the index of their render operation, so tiles can cull groups in parallel
+	uint group = 0;
+	for (uint i = 0; i < ops.size(); ++i) {
+		if (ops[i].type == OP::RENDER) {
+			AABB& aabb = groupAabbs[group++];
+			uniforms.renderBounds[i] = {aabb.getMin(), aabb.getMax()};
+		}
+	}
+
+	historyValid = false; // reprojected shading belongs to the old scene
+	clipmapValid = false;
 }
@@ -1,6 +1,7 @@
 #include "shader_structs.hpp"
 
 #include <glm/gtx/matrix_decompose.hpp>
+#include <cstddef>
 
 namespace Primrose {
 	std::map<PRIM, std::string> PRIM_NAMES = {
@@ -31,6 +32,7 @@ namespace Primrose {
 		{ OP::IDENTITY, "IDENTITY" },
 		{ OP::TRANSFORM, "TRANSFORM" },
 		{ OP::RENDER, "RENDER" },
+		{ OP::BRICK, "BRICK" },
 	};
 	std::map<OP_FLAG, std::string> OP_FLAG_NAMES = {
 		{ OP_FLAG::NONE, "NONE" },
@@ -40,6 +42,11 @@ namespace Primrose {
 		{ UI::PANEL, "PANEL" },
 		{ UI::TEXT, "TEXT" },
 	};
+	std::map<QUALITY, std::string> QUALITY_NAMES = {
+		{ QUALITY::LOW, "LOW" },
+		{ QUALITY::MEDIUM, "MEDIUM" },
+		{ QUALITY::HIGH, "HIGH" },
+	};
 }
 
 glm::vec3 Primrose::getTranslate(glm::mat4 transform) {
@@ -104,6 +111,30 @@ namespace {
 	}
 }
 
+Primrose::QualitySettings Primrose::QualitySettings::preset(QUALITY quality) {
+	switch (quality) {
+		case QUALITY::LOW: // laptops, blurrier edges and at most one reflection
+			return { 48, 1, 0.004f, 0.0004f, 500.f, VK_TRUE };
+		case QUALITY::MEDIUM:
+			return { 72, 3, 0.002f, 0.0002f, 2000.f, VK_TRUE };
+		case QUALITY::HIGH:
+			return { 100, MAX_BOUNCE_LEVELS, 0.001f, 0.0001f, 10000.f, VK_TRUE };
+	}
+	throw std::runtime_error(fmt::format("unknown quality preset {}", static_cast<uint>(quality)));
+}
+
+vk::SpecializationInfo Primrose::QualitySettings::specializationInfo() const {
+	static const std::array<vk::SpecializationMapEntry, 6> entries = {
+		vk::SpecializationMapEntry(0, offsetof(QualitySettings, maxMarches), sizeof(int)),
+		vk::SpecializationMapEntry(1, offsetof(QualitySettings, maxBounces), sizeof(uint)),
+		vk::SpecializationMapEntry(2, offsetof(QualitySettings, hitMargin), sizeof(float)),
+		vk::SpecializationMapEntry(3, offsetof(QualitySettings, normalEps), sizeof(float)),
+		vk::SpecializationMapEntry(4, offsetof(QualitySettings, maxDist), sizeof(float)),
+		vk::SpecializationMapEntry(5, offsetof(QualitySettings, debugBackground), sizeof(vk::Bool32)),
+	};
+	return vk::SpecializationInfo(entries.size(), entries.data(), sizeof(QualitySettings), this);
+}
+
 std::string Primrose::MarchUniforms::toString() {
 	std::string out = "";
 
@@ -113,6 +144,7 @@ std::string Primrose::MarchUniforms::toString() {
 	out += fmt::format("screenHeight: {:.4}\n", screenHeight);
 	out += fmt::format("focalLength: {:.4}\n", focalLength);
 	out += fmt::format("invZoom: {:.4}\n", invZoom);
+	out += fmt::format("relaxation: {:.4}\n", relaxation);
 	out += fmt::format("numOperations: {}\n", numOperations);
 
 	std::vector<std::string> line;
@@ -137,6 +169,7 @@ std::string Primrose::MarchUniforms::toString() {
 			case OP::INTERSECTION:
 			case OP::DIFFERENCE:
 			case OP::RENDER:
+			case OP::BRICK:
 				break;
 		}
 
@@ -145,6 +178,7 @@ std::string Primrose::MarchUniforms::toString() {
 			case OP::UNION:
 			case OP::INTERSECTION:
 			case OP::DIFFERENCE:
+			case OP::BRICK:
 				params = fmt::format("{} {}", op.i, op.j);
 				break;
 			case OP::IDENTITY:
@@ -193,12 +227,14 @@ std::string Primrose::MarchUniforms::toString() {
 			case PRIM::LINE:
 				line.push_back(fmt::format("({}: {} {})", i, PRIM_NAMES[p.type], p.a));
 				break;
+			case PRIM::P5:
+			case PRIM::P6:
+				line.push_back(fmt::format("({}: {} {} {})", i, PRIM_NAMES[p.type], p.a, p.b));
+				break;
 			case PRIM::P1:
 			case PRIM::P2:
 			case PRIM::P3:
 			case PRIM::P4:
-			case PRIM::P5:
-			case PRIM::P6:
 			case PRIM::P7:
 			case PRIM::P8:
 			case PRIM::P9:
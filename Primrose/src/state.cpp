@@ -9,12 +9,30 @@ namespace Primrose {
 	float currentTime;
 	float deltaTime;
 
+	float targetFrameTime = 0.f;
+	float renderScale = 1.f;
+
+	unsigned int frameIndex = 0;
+	bool historyValid = false;
+	vk::Extent2D historyExtent;
+	unsigned int historyRefresh = 8;
+	unsigned int interleave = 1;
+	unsigned int bounceScale = 1;
+	QualitySettings quality = QualitySettings::preset(QUALITY::HIGH); // replaced from Settings::qualityPreset by setup
+	float marchStepsPerPixel = 0.f;
+	unsigned int droppedBounces = 0;
+
 	bool windowResized = false;
 	bool windowMinimized = false;
 	bool windowFocused = false;
 
 	MarchUniforms uniforms = {};
 
+	std::vector<StaticSubtree> staticSubtrees{};
+	bool bricksBaked = true;
+	bool clipmapValid = false;
+	StructureMemory structureMemory = {};
+
 	std::vector<std::unique_ptr<UIElement>> uiScene{};
 
 	const std::vector<const char*> VALIDATION_LAYERS = { "VK_LAYER_KHRONOS_validation" };
@@ -61,6 +79,22 @@ namespace Primrose {
 		const bool validationEnabled = true;
 #endif
 
+		const bool traceToSwapchain = true; // write rays straight into swapchain images when storage is supported
+		const bool preferComputeMarch = true; // march in a compute shader rather than the fragment shader without rt
+		const float minRenderScale = 0.5f; // lower bound for the dynamic resolution controller
+		const float relaxation = 1.2f; // default sphere tracing over-relaxation, see setRelaxation
+		const float bounceBudget = 0.5f; // bounce rays queued per frame per pixel, the rest are counted and dropped
+		const QUALITY qualityPreset = QUALITY::HIGH;
+		const uint brickResolution = 16; // brick cache cells along the longest side of a static subtree
+		const uint clipmapResolution = 64; // texels per side of each clipmap level
+		const uint clipmapLevels = 8; // at most MAX_CLIPMAP_LEVELS, each covers twice the size of the last
+		static_assert(clipmapLevels <= MAX_CLIPMAP_LEVELS, "clipmapLevels don't fit in MarchUniforms::clipmapOrigins");
+		const float clipmapTexel = 0.25f; // texel size of the finest clipmap level
+		const bool compactStructures = true; // copy each blas into a right-sized buffer after it is built
+		const uint maxTopRefits = 8; // transform edits refitting the tlas before it is rebuilt from scratch
+		const float aabbSplitCost = 1.f; // cost of an extra aabb primitive, in terms marched through its parent
+		const uint boundsSubdivisions = 4; // times tightened bounds are halved, see Node::tightenAabb
+
 		const int MAX_NUM_PRIMITIVES = 100;
 		const int MAX_NUM_OPERATIONS = 100;
 